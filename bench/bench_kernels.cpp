@@ -0,0 +1,291 @@
+// Microbenchmarks for mygit's hot kernels: SHA-1, zstr compression, parallel
+// deflate of large objects, tree parsing and commit-header parsing.
+//
+//   mygit-bench [--json out.json] [--compare baseline.json] [--threshold pct] [--filter substr]
+//
+// Results are printed as JSON (one benchmark per line). With --compare, every
+// benchmark whose ns/op grew by more than the threshold (default 10%) against
+// the baseline file is reported and the exit status is 1.
+
+// The kernels are internal to libmygit (mygit.hpp only exposes the API), so
+// its source is compiled in directly.
+#include "../mygit.cpp"
+
+#include <chrono>
+#include <functional>
+#include <random>
+
+struct BenchResult 
+{
+    string name;
+    double nsPerOp;
+    double mbPerSec;
+    long iterations;
+};
+
+// Keeps the optimizer from discarding benchmark results
+static volatile size_t benchSink;
+
+// Run op until minSeconds have passed, five times, and keep the median ns/op
+static BenchResult runBench(const string &name, size_t bytesPerOp, const function<void()> &op, double minSeconds = 0.2) 
+{
+    using clock = chrono::steady_clock;
+    vector<double> samples;
+    long iterations = 0;
+    for (int round = 0; round < 5; ++round) 
+    {
+        long count = 0;
+        auto start = clock::now();
+        double elapsed = 0;
+        do 
+        {
+            op();
+            ++count;
+            elapsed = chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < minSeconds / 5);
+        samples.push_back(elapsed * 1e9 / count);
+        iterations += count;
+    }
+    sort(samples.begin(), samples.end());
+    double nsPerOp = samples[samples.size() / 2];
+    double mbPerSec = bytesPerOp ? (bytesPerOp / (1024.0 * 1024.0)) / (nsPerOp / 1e9) : 0;
+    return BenchResult{name, nsPerOp, mbPerSec, iterations};
+}
+
+// Mixed text/binary data that compresses roughly like source trees do
+static string makePayload(size_t size, unsigned seed) 
+{
+    mt19937 rng(seed);
+    static const char *words[] = {"int ", "return ", "string ", "for (", "while (", "{\n", "}\n", "    ", "const ", "auto "};
+    string data;
+    data.reserve(size);
+    while (data.size() < size) 
+    {
+        if (rng() % 8 == 0) 
+        {
+            data.push_back(char(rng()));
+        } 
+        else 
+        {
+            data += words[rng() % 10];
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+// A tree object with count entries, in the legacy text or the binary format
+static string makeTree(size_t count, bool binary) 
+{
+    vector<TreeItem> items;
+    ostringstream lines;
+    for (size_t i = 0; i < count; ++i) 
+    {
+        string sha = generateSHA1FromData(to_string(i));
+        string name = "file_" + to_string(i) + ".cpp";
+        items.push_back(TreeItem{i % 7 == 0 ? treeMode : 0100644u, sha, name});
+        lines << (i % 7 == 0 ? "040000 tree " : "100644 blob ") << sha << " " << name << "\n";
+    }
+    return binary ? serializeTree(items) : lines.str();
+}
+
+static string makeCommitText() 
+{
+    return "tree " + generateSHA1FromData("tree") + "\n"
+           "parent " + generateSHA1FromData("parent") + "\n"
+           "Committer someone <someone@students.iit.ac.in>\n"
+           "Timestamp 2024-01-01 12:00:00 +0530\n"
+           "Message Refactor the object store\n";
+}
+
+static vector<BenchResult> runAll(const string &filter) 
+{
+    vector<BenchResult> results;
+    auto add = [&](const string &name, size_t bytes, const function<void()> &op) 
+    {
+        if (filter.empty() || name.find(filter) != string::npos) 
+        {
+            results.push_back(runBench(name, bytes, op));
+        }
+    };
+
+    for (size_t size : {64, 4096, 1 << 20, 16 << 20}) 
+    {
+        string data = makePayload(size, 1);
+        add("sha1/" + to_string(size), size, [&] { benchSink = benchSink + generateSHA1FromData(data)[0]; });
+    }
+
+    string payload = makePayload(4 << 20, 2);
+    for (size_t buffSize : {4096, 65536, 1 << 20}) 
+    {
+        add("zstr_compress/buf=" + to_string(buffSize), payload.size(), [&] 
+        {
+            ostringstream sink;
+            {
+                zstr::ostream compressed(sink, buffSize);
+                compressed << payload;
+            }
+            benchSink = benchSink + sink.str().size();
+        });
+
+        ostringstream packed;
+        {
+            zstr::ostream compressed(packed);
+            compressed << payload;
+        }
+        string packedData = packed.str();
+        add("zstr_decompress/buf=" + to_string(buffSize), payload.size(), [&] 
+        {
+            istringstream source(packedData);
+            zstr::istream decompressed(source, buffSize);
+            ostringstream out;
+            out << decompressed.rdbuf();
+            benchSink = benchSink + out.str().size();
+        });
+    }
+
+    string largeObject = makePayload(16 << 20, 3);
+    for (unsigned threads : {1u, 2u, 4u, 8u}) 
+    {
+        add("deflate_parallel/threads=" + to_string(threads), largeObject.size(), [&] 
+        {
+            benchSink = benchSink + parallelDeflate(largeObject, threads).size();
+        });
+    }
+
+    for (bool binary : {false, true}) 
+    {
+        for (size_t count : {16, 1000, 100000}) 
+        {
+            string tree = makeTree(count, binary);
+            add(string(binary ? "tree_parse_binary" : "tree_parse") + "/entries=" + to_string(count), tree.size(), [&] 
+            {
+                TreeReader reader(tree);
+                TreeEntryView entry;
+                size_t total = 0;
+                while (reader.next(entry)) 
+                {
+                    total += entry.name.size();
+                }
+                benchSink = benchSink + total;
+            });
+        }
+    }
+
+    string commitText = makeCommitText();
+    add("commit_parse", commitText.size(), [&] 
+    {
+        CommitView view;
+        parseCommit(commitText, view);
+        benchSink = benchSink + view.parent.size();
+    });
+
+    return results;
+}
+
+static string toJson(const vector<BenchResult> &results) 
+{
+    ostringstream json;
+    json << "{\"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) 
+    {
+        const BenchResult &r = results[i];
+        json << "  {\"name\": \"" << r.name << "\", \"ns_per_op\": " << fixed << setprecision(1) << r.nsPerOp
+             << ", \"mb_per_s\": " << setprecision(2) << r.mbPerSec << ", \"iterations\": " << r.iterations << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "]}\n";
+    return json.str();
+}
+
+// Read name -> ns/op back from a file written by toJson
+static map<string, double> readBaseline(const string &fileName) 
+{
+    map<string, double> baseline;
+    ifstream input(fileName);
+    string line;
+    while (getline(input, line)) 
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t ns = line.find("\"ns_per_op\": ");
+        if (name == string::npos || ns == string::npos) 
+        {
+            continue;
+        }
+        name += 9;
+        baseline[line.substr(name, line.find('"', name) - name)] = stod(line.substr(ns + 13));
+    }
+    return baseline;
+}
+
+int main(int argc, char *argv[]) 
+{
+    string jsonPath, comparePath, filter;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; ++i) 
+    {
+        string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) 
+        {
+            jsonPath = argv[++i];
+        } 
+        else if (arg == "--compare" && i + 1 < argc) 
+        {
+            comparePath = argv[++i];
+        } 
+        else if (arg == "--threshold" && i + 1 < argc) 
+        {
+            threshold = stod(argv[++i]);
+        } 
+        else if (arg == "--filter" && i + 1 < argc) 
+        {
+            filter = argv[++i];
+        } 
+        else 
+        {
+            cerr << "Usage: mygit-bench [--json out.json] [--compare baseline.json] [--threshold pct] [--filter substr]\n";
+            return 1;
+        }
+    }
+
+    map<string, double> baseline;
+    if (!comparePath.empty()) 
+    {
+        baseline = readBaseline(comparePath);
+        if (baseline.empty()) 
+        {
+            cerr << "Error: No benchmarks found in " << comparePath << ".\n";
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results = runAll(filter);
+    string json = toJson(results);
+    cout << json;
+    if (!jsonPath.empty()) 
+    {
+        ofstream(jsonPath) << json;
+    }
+
+    int regressions = 0;
+    for (const BenchResult &r : results) 
+    {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) 
+        {
+            continue;
+        }
+        double change = (r.nsPerOp - it->second) * 100.0 / it->second;
+        if (change > threshold) 
+        {
+            cerr << "REGRESSION " << r.name << ": " << fixed << setprecision(1) << it->second << " -> " << r.nsPerOp
+                 << " ns/op (+" << change << "%)\n";
+            ++regressions;
+        }
+    }
+    if (!comparePath.empty()) 
+    {
+        cerr << regressions << " regression(s) above " << threshold << "% against " << comparePath << "\n";
+    }
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+// Deterministic synthetic-repository generator.
+//
+//   mygit-gen <out-dir> [--preset small|medium|prod] [--files N] [--dirs N] [--depth N]
+//             [--commits N] [--churn N] [--binary-pct P] [--avg-size BYTES] [--seed S]
+//             [--mygit PATH] [--no-history]
+//
+// Builds a worktree of N files spread over a random directory tree, then (unless
+// --no-history) initializes a .mygit repository and records --commits commits,
+// each editing, adding and deleting a few files. The same seed always produces
+// the same paths, bytes and history: only mt19937_64 (whose output the standard
+// fixes) is used, never the implementation-defined std distributions.
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <set>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace filesystem;
+
+struct GenOptions 
+{
+    path outDir;
+    long files = 10000;
+    long dirs = 500;
+    int depth = 8;
+    long commits = 20;
+    long churn = 50;
+    int binaryPct = 10;
+    long avgSize = 2048;
+    uint64_t seed = 1;
+    string mygit = "mygit";
+    bool history = true;
+};
+
+static void applyPreset(GenOptions &opts, const string &preset) 
+{
+    if (preset == "small") 
+    {
+        opts.files = 2000; opts.dirs = 100; opts.depth = 6; opts.commits = 10; opts.churn = 20;
+    } 
+    else if (preset == "medium") 
+    {
+        opts.files = 100000; opts.dirs = 5000; opts.depth = 10; opts.commits = 50; opts.churn = 200;
+    } 
+    else if (preset == "prod") 
+    {
+        opts.files = 1000000; opts.dirs = 50000; opts.depth = 14; opts.commits = 200; opts.churn = 1000;
+    } 
+    else 
+    {
+        throw runtime_error("unknown preset " + preset);
+    }
+}
+
+// Uniform integer in [0, bound) from the raw generator
+static uint64_t pick(mt19937_64 &rng, uint64_t bound) 
+{
+    return bound ? rng() % bound : 0;
+}
+
+// Sizes are skewed: most files are small, a few are large
+static size_t pickSize(mt19937_64 &rng, long avgSize) 
+{
+    uint64_t roll = pick(rng, 100);
+    if (roll < 70) return pick(rng, avgSize) + 1;
+    if (roll < 95) return avgSize + pick(rng, avgSize * 4);
+    return avgSize * 8 + pick(rng, avgSize * 64);
+}
+
+static string makeContent(uint64_t seed, bool binary, size_t size) 
+{
+    static const char *words[] = {"alpha", "beta", "gamma", "delta", "return", "value", "index", "tree",
+                                  "commit", "object", "int", "const", "string", "vector", "while", "for"};
+    mt19937_64 rng(seed);
+    string data;
+    data.reserve(size + 16);
+    if (binary) 
+    {
+        while (data.size() < size) 
+        {
+            uint64_t word = rng();
+            data.append(reinterpret_cast<const char *>(&word), sizeof(word));
+        }
+    } 
+    else 
+    {
+        while (data.size() < size) 
+        {
+            data += words[pick(rng, 16)];
+            data += pick(rng, 8) == 0 ? '\n' : ' ';
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+struct GenFile 
+{
+    string path;
+    bool binary;
+    size_t size;
+    uint64_t version = 0;
+};
+
+// FNV-1a, so content seeds don't depend on the standard library's std::hash
+static uint64_t hashPath(const string &text) 
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : text) 
+    {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void writeFile(const path &root, const GenFile &file, uint64_t seed) 
+{
+    // Content depends only on (seed, path, version)
+    uint64_t contentSeed = seed ^ hashPath(file.path) ^ (file.version << 32);
+    ofstream out(root / file.path, ios::binary | ios::trunc);
+    out << makeContent(contentSeed, file.binary, file.size);
+}
+
+// Run mygit in the generated repository, passing paths in batches
+static void runMygit(const GenOptions &opts, vector<string> args) 
+{
+    pid_t pid = fork();
+    if (pid == 0) 
+    {
+        if (chdir(opts.outDir.c_str()) != 0) _exit(127);
+        if (!freopen("/dev/null", "w", stdout)) _exit(127);
+        vector<char *> argv;
+        argv.push_back(const_cast<char *>(opts.mygit.c_str()));
+        for (string &arg : args) argv.push_back(arg.data());
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) 
+    {
+        throw runtime_error("mygit " + (args.empty() ? string() : args[0]) + " failed");
+    }
+}
+
+static void addPaths(const GenOptions &opts, const vector<string> &paths) 
+{
+    const size_t batch = 2000;
+    for (size_t i = 0; i < paths.size(); i += batch) 
+    {
+        vector<string> args = {"add"};
+        args.insert(args.end(), paths.begin() + i, paths.begin() + min(paths.size(), i + batch));
+        runMygit(opts, args);
+    }
+}
+
+int main(int argc, char *argv[]) 
+{
+    GenOptions opts;
+    try 
+    {
+        for (int i = 1; i < argc; ++i) 
+        {
+            string arg = argv[i];
+            auto next = [&]() -> string 
+            {
+                if (i + 1 >= argc) throw runtime_error("missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "--preset") applyPreset(opts, next());
+            else if (arg == "--files") opts.files = stol(next());
+            else if (arg == "--dirs") opts.dirs = stol(next());
+            else if (arg == "--depth") opts.depth = stoi(next());
+            else if (arg == "--commits") opts.commits = stol(next());
+            else if (arg == "--churn") opts.churn = stol(next());
+            else if (arg == "--binary-pct") opts.binaryPct = stoi(next());
+            else if (arg == "--avg-size") opts.avgSize = stol(next());
+            else if (arg == "--seed") opts.seed = stoull(next());
+            else if (arg == "--mygit") opts.mygit = absolute(next()).string();
+            else if (arg == "--no-history") opts.history = false;
+            else if (!arg.empty() && arg[0] != '-' && opts.outDir.empty()) opts.outDir = arg;
+            else throw runtime_error("unknown argument " + arg);
+        }
+        if (opts.outDir.empty()) 
+        {
+            throw runtime_error("missing output directory");
+        }
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error: " << e.what() << "\n"
+             << "Usage: mygit-gen <out-dir> [--preset small|medium|prod] [--files N] [--dirs N] [--depth N]\n"
+             << "                 [--commits N] [--churn N] [--binary-pct P] [--avg-size BYTES] [--seed S]\n"
+             << "                 [--mygit PATH] [--no-history]\n";
+        return 1;
+    }
+
+    try 
+    {
+        if (exists(opts.outDir) && !filesystem::is_empty(opts.outDir)) 
+        {
+            throw runtime_error(opts.outDir.string() + " exists and is not empty");
+        }
+        create_directories(opts.outDir);
+        mt19937_64 rng(opts.seed);
+
+        // Directory tree: each directory hangs off a random shallower one
+        vector<string> dirs = {""};
+        vector<int> depths = {0};
+        for (long i = 1; i <= opts.dirs; ++i) 
+        {
+            size_t parent = pick(rng, dirs.size());
+            while (depths[parent] >= opts.depth) parent = pick(rng, dirs.size());
+            string dir = (dirs[parent].empty() ? "" : dirs[parent] + "/") + "d" + to_string(i);
+            dirs.push_back(dir);
+            depths.push_back(depths[parent] + 1);
+            create_directories(opts.outDir / dir);
+        }
+
+        auto newFile = [&](long id) 
+        {
+            GenFile file;
+            const string &dir = dirs[pick(rng, dirs.size())];
+            file.binary = long(pick(rng, 100)) < opts.binaryPct;
+            file.path = (dir.empty() ? "" : dir + "/") + "f" + to_string(id) + (file.binary ? ".bin" : ".txt");
+            file.size = pickSize(rng, opts.avgSize);
+            return file;
+        };
+
+        vector<GenFile> files;
+        files.reserve(opts.files);
+        uint64_t totalBytes = 0;
+        for (long i = 0; i < opts.files; ++i) 
+        {
+            files.push_back(newFile(i));
+            writeFile(opts.outDir, files.back(), opts.seed);
+            totalBytes += files.back().size;
+        }
+        cerr << "Generated " << files.size() << " files (" << totalBytes << " bytes) in " << dirs.size() << " directories\n";
+
+        if (!opts.history) 
+        {
+            return 0;
+        }
+
+        runMygit(opts, {"init"});
+        runMygit(opts, {"add", "."});
+        runMygit(opts, {"commit", "-m", "Initial import"});
+
+        long nextId = opts.files;
+        for (long c = 1; c < opts.commits; ++c) 
+        {
+            vector<string> touched;
+            set<string> created;  // new this round; deleting one again leaves nothing to stage
+            for (long k = 0; k < opts.churn && !files.empty(); ++k) 
+            {
+                uint64_t action = pick(rng, 10);
+                if (action < 7) 
+                {
+                    // Edit an existing file
+                    GenFile &file = files[pick(rng, files.size())];
+                    ++file.version;
+                    writeFile(opts.outDir, file, opts.seed);
+                    touched.push_back(file.path);
+                } 
+                else if (action < 9) 
+                {
+                    files.push_back(newFile(nextId++));
+                    writeFile(opts.outDir, files.back(), opts.seed);
+                    touched.push_back(files.back().path);
+                    created.insert(files.back().path);
+                } 
+                else 
+                {
+                    size_t victim = pick(rng, files.size());
+                    const string &gone = files[victim].path;
+                    remove(opts.outDir / gone);
+                    if (created.erase(gone)) 
+                    {
+                        touched.erase(std::remove(touched.begin(), touched.end(), gone), touched.end());
+                    } 
+                    else 
+                    {
+                        touched.push_back(gone);
+                    }
+                    files[victim] = files.back();
+                    files.pop_back();
+                }
+            }
+            sort(touched.begin(), touched.end());
+            touched.erase(unique(touched.begin(), touched.end()), touched.end());
+            addPaths(opts, touched);
+            runMygit(opts, {"commit", "-m", "Synthetic change " + to_string(c)});
+        }
+        cerr << "Recorded " << opts.commits << " commits\n";
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+// End-to-end scale benchmark: runs mygit commands against a (generated)
+// repository and reports per-command resource usage.
+//
+//   mygit-scale-bench <repo-dir> [--mygit PATH] [--json out.json] [--count-syscalls]
+//
+// The driver rewrites scale-bench-marker.txt at the repository root so there is
+// always something to commit, then runs in order: add ., write-tree, commit,
+// log, checkout of the root commit and checkout back to the new commit. For each one the driver
+// reports wall time, user+system CPU, peak RSS (from wait4), and the read/write
+// syscall counts and bytes from /proc/<pid>/io, sampled while the child is a
+// zombie. With --count-syscalls every syscall is counted under ptrace instead;
+// that slows the child down, so don't compare its timings with normal runs.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <iomanip>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace filesystem;
+
+struct RunStats 
+{
+    string command;
+    int exitStatus = 0;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    long peakRssKb = 0;
+    long syscalls = -1;      // only with --count-syscalls
+    map<string, long> io;    // rchar, wchar, syscr, syscw, read_bytes, write_bytes
+    string output;
+};
+
+static map<string, long> readProcIo(pid_t pid) 
+{
+    map<string, long> io;
+    ifstream ioFile("/proc/" + to_string(pid) + "/io");
+    string key;
+    long value;
+    while (ioFile >> key >> value) 
+    {
+        key.pop_back();  // trailing ':'
+        io[key] = value;
+    }
+    return io;
+}
+
+// Let a traced child run until it starts exiting, counting syscall entries
+static long countSyscalls(pid_t pid) 
+{
+    int status = 0;
+    waitpid(pid, &status, 0);  // stopped by PTRACE_TRACEME's exec trap
+    if (!WIFSTOPPED(status)) 
+    {
+        return -1;  // exited without being traced; leave it for wait4
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL | PTRACE_O_TRACEEXIT);
+    long stops = 0;
+    while (ptrace(PTRACE_SYSCALL, pid, 0, 0) == 0) 
+    {
+        if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) break;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) 
+        {
+            ++stops;
+        } 
+        else if ((status >> 8) == (SIGTRAP | (PTRACE_EVENT_EXIT << 8))) 
+        {
+            // Detach so the caller can collect the exit status and rusage itself
+            ptrace(PTRACE_DETACH, pid, 0, 0);
+            break;
+        }
+    }
+    return (stops + 1) / 2;  // one stop on entry, one on exit (exit_group only enters)
+}
+
+static RunStats runCommand(const path &repo, const string &mygit, const vector<string> &args, bool traceSyscalls) 
+{
+    RunStats stats;
+    for (const string &arg : args) stats.command += (stats.command.empty() ? "" : " ") + arg;
+
+    char outputPath[] = "/tmp/mygit-scale-XXXXXX";
+    int outputFd = mkstemp(outputPath);
+    if (outputFd < 0) 
+    {
+        cerr << "Error: Cannot create " << outputPath << " to capture output: " << strerror(errno) << "\n";
+        exit(1);
+    }
+    unlink(outputPath);
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) 
+    {
+        if (chdir(repo.c_str()) != 0) _exit(127);
+        dup2(outputFd, STDOUT_FILENO);
+        if (traceSyscalls && ptrace(PTRACE_TRACEME, 0, 0, 0) != 0) 
+        {
+            perror("ptrace");
+            _exit(126);
+        }
+        vector<char *> argv;
+        argv.push_back(const_cast<char *>(mygit.c_str()));
+        for (const string &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    if (traceSyscalls) 
+    {
+        stats.syscalls = countSyscalls(pid);
+    }
+
+    siginfo_t info{};
+    waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+    stats.io = readProcIo(pid);
+
+    int status = 0;
+    struct rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    stats.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    stats.peakRssKb = usage.ru_maxrss;
+    stats.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    lseek(outputFd, 0, SEEK_SET);
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(outputFd, buffer, sizeof(buffer))) > 0) stats.output.append(buffer, n);
+    close(outputFd);
+    return stats;
+}
+
+static long ioValue(const RunStats &stats, const string &key) 
+{
+    auto it = stats.io.find(key);
+    return it == stats.io.end() ? -1 : it->second;
+}
+
+// Last SHA printed after a given label, e.g. "Commit: " in log output
+static string lastShaAfter(const string &output, const string &label) 
+{
+    string sha;
+    size_t pos = 0;
+    while ((pos = output.find(label, pos)) != string::npos) 
+    {
+        pos += label.size();
+        sha = output.substr(pos, 40);
+    }
+    return sha;
+}
+
+int main(int argc, char *argv[]) 
+{
+    path repo;
+    string mygit = "mygit";
+    string jsonPath;
+    bool traceSyscalls = false;
+    for (int i = 1; i < argc; ++i) 
+    {
+        string arg = argv[i];
+        if (arg == "--mygit" && i + 1 < argc) mygit = argv[++i];
+        else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg == "--count-syscalls") traceSyscalls = true;
+        else if (!arg.empty() && arg[0] != '-' && repo.empty()) repo = arg;
+        else 
+        {
+            cerr << "Usage: mygit-scale-bench <repo-dir> [--mygit PATH] [--json out.json] [--count-syscalls]\n";
+            return 1;
+        }
+    }
+    if (repo.empty() || !exists(repo / ".mygit")) 
+    {
+        cerr << "Error: " << repo << " is not a mygit repository (see mygit-gen).\n";
+        return 1;
+    }
+    mygit = absolute(mygit).string();
+
+    vector<RunStats> runs;
+    auto run = [&](const vector<string> &args) -> const RunStats & 
+    {
+        runs.push_back(runCommand(repo, mygit, args, traceSyscalls));
+        return runs.back();
+    };
+
+    // Give add and commit a real change to record
+    ofstream(repo / "scale-bench-marker.txt") << chrono::system_clock::now().time_since_epoch().count() << "\n";
+
+    run({"add", "."});
+    run({"write-tree"});
+    string commitSha = lastShaAfter(run({"commit", "-m", "scale benchmark"}).output, "Created commit: ");
+    string rootSha = lastShaAfter(run({"log"}).output, "Commit: ");
+    if (!rootSha.empty()) 
+    {
+        run({"checkout", rootSha});
+    }
+    if (!commitSha.empty()) 
+    {
+        run({"checkout", commitSha});
+    }
+
+    cout << left << setw(24) << "command" << right << setw(10) << "wall s" << setw(10) << "cpu s" << setw(12) << "rss KiB"
+         << setw(12) << "syscalls" << setw(10) << "syscr" << setw(10) << "syscw" << setw(14) << "read B" << setw(14) << "written B" << "\n";
+    ostringstream json;
+    json << "{\"runs\": [\n";
+    for (size_t i = 0; i < runs.size(); ++i) 
+    {
+        const RunStats &r = runs[i];
+        string name = r.command.substr(0, 23);
+        cout << left << setw(24) << name << right << fixed << setprecision(3) << setw(10) << r.wallSeconds << setw(10) << r.cpuSeconds
+             << setw(12) << r.peakRssKb << setw(12) << (r.syscalls < 0 ? string("-") : to_string(r.syscalls))
+             << setw(10) << ioValue(r, "syscr") << setw(10) << ioValue(r, "syscw") << setw(14) << ioValue(r, "rchar") << setw(14) << ioValue(r, "wchar")
+             << (r.exitStatus ? "  (exit " + to_string(r.exitStatus) + ")" : "") << "\n";
+        json << "  {\"command\": \"" << r.command << "\", \"exit\": " << r.exitStatus << fixed << setprecision(6)
+             << ", \"wall_s\": " << r.wallSeconds << ", \"cpu_s\": " << r.cpuSeconds << ", \"peak_rss_kb\": " << r.peakRssKb
+             << ", \"syscalls\": " << r.syscalls;
+        for (const auto &[key, value] : r.io) 
+        {
+            json << ", \"" << key << "\": " << value;
+        }
+        json << "}" << (i + 1 < runs.size() ? "," : "") << "\n";
+    }
+    json << "]}\n";
+    if (!jsonPath.empty()) 
+    {
+        ofstream(jsonPath) << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,7290 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <openssl/sha.h> 
+#include <vector>
+#include "zstr.hpp"
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
+#include <cstring>
+#include <string_view>
+#include <functional>
+#include <thread>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <climits>
+#include <limits>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <condition_variable>
+#include <charconv>
+#include "mygit.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+// The .mygit directory everything below works on. The CLI uses ./.mygit; a
+// Repository points it at its own directory for the duration of each call.
+thread_local path currentGitDir = ".mygit";
+
+const path &gitDir() 
+{
+    return currentGitDir;
+}
+
+// Where object sha is stored
+path objectFilePath(const string &sha) 
+{
+    return currentGitDir / "objects" / sha.substr(0, 2) / sha.substr(2);
+}
+
+// Failures inside a Repository call are recorded for Repository::error();
+// everywhere else they are printed like any other command error
+thread_local string *errorSink = nullptr;
+
+void reportError(const string &message) 
+{
+    if (errorSink) 
+    {
+        *errorSink = message;
+        return;
+    }
+    cerr << "Error: " << message << "\n";
+}
+
+static const int rawShaLength = SHA_DIGEST_LENGTH;
+
+// Write the 40 hex digits of id to out (not NUL-terminated)
+void shaToHex(const unsigned char *id, char *out) 
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < rawShaLength; i++) 
+    {
+        out[2 * i] = digits[id[i] >> 4];
+        out[2 * i + 1] = digits[id[i] & 0xf];
+    }
+}
+
+string shaToHex(const unsigned char *id) 
+{
+    string hex(rawShaLength * 2, '0');
+    shaToHex(id, &hex[0]);
+    return hex;
+}
+
+// Branch-free hex decoding: SHA digits are random, so comparisons mispredict
+struct HexTable 
+{
+    signed char value[256];
+
+    HexTable() 
+    {
+        memset(value, -1, sizeof(value));
+        for (int i = 0; i < 10; i++) value['0' + i] = i;
+        for (int i = 0; i < 6; i++) value['a' + i] = value['A' + i] = 10 + i;
+    }
+};
+
+static const HexTable hexTable;
+
+static int hexDigitValue(char c) 
+{
+    return hexTable.value[static_cast<unsigned char>(c)];
+}
+
+bool hexToSha(string_view hex, unsigned char *id) 
+{
+    if (hex.size() != size_t(rawShaLength * 2)) 
+    {
+        return false;
+    }
+    for (int i = 0; i < rawShaLength; i++) 
+    {
+        int high = hexDigitValue(hex[2 * i]);
+        int low = hexDigitValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) 
+        {
+            return false;
+        }
+        id[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    return true;
+}
+
+string generateSHA1FromData(string_view input) 
+{
+    unsigned char hashBuffer[SHA_DIGEST_LENGTH];
+    SHA_CTX shaState;
+    SHA1_Init(&shaState);
+    SHA1_Update(&shaState, input.data(), input.size());
+    SHA1_Final(hashBuffer, &shaState);
+    return shaToHex(hashBuffer);
+}
+
+
+// Worker threads for parallel work: MYGIT_THREADS, else one per core
+unsigned workerCount() 
+{
+    const char *configured = getenv("MYGIT_THREADS");
+    if (configured && atoi(configured) > 0) 
+    {
+        return unsigned(atoi(configured));
+    }
+    return max(1u, thread::hardware_concurrency());
+}
+
+// Objects at least this big are deflated pigz-style: independent 128 KiB
+// blocks compressed on several threads (each primed with the previous 32 KiB
+// as a dictionary), joined into one gzip member whose CRC-32 is combined from
+// the per-block CRCs. Any gzip reader, zstr included, inflates the result.
+static const size_t parallelDeflateThreshold = 1024 * 1024;
+static const size_t deflateBlockSize = 128 * 1024;
+static const size_t deflateDictionarySize = 32 * 1024;
+
+string parallelDeflate(string_view data, unsigned threads) 
+{
+    TraceSpan span("deflate.parallel");
+    span.arg("size", data.size());
+    size_t blockCount = (data.size() + deflateBlockSize - 1) / deflateBlockSize;
+    vector<string> compressed(blockCount);
+    vector<uLong> crcs(blockCount);
+    atomic<size_t> nextBlock{0};
+    atomic<bool> failed{false};
+
+    auto worker = [&] 
+    {
+        z_stream stream{};
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) 
+        {
+            failed = true;
+            return;
+        }
+        for (size_t block = nextBlock++; block < blockCount; block = nextBlock++) 
+        {
+            size_t offset = block * deflateBlockSize;
+            size_t length = min(deflateBlockSize, data.size() - offset);
+            const Bytef *input = reinterpret_cast<const Bytef *>(data.data() + offset);
+            crcs[block] = crc32(0, input, uInt(length));
+
+            deflateReset(&stream);
+            if (block > 0) 
+            {
+                size_t dictionaryLength = min(deflateDictionarySize, offset);
+                deflateSetDictionary(&stream, input - dictionaryLength, uInt(dictionaryLength));
+            }
+            string &out = compressed[block];
+            out.resize(deflateBound(&stream, uLong(length)) + 16);
+            stream.next_in = const_cast<Bytef *>(input);
+            stream.avail_in = uInt(length);
+            stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+            stream.avail_out = uInt(out.size());
+            // Sync-flush keeps every block byte-aligned so they can be concatenated
+            bool last = (block + 1 == blockCount);
+            int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            if (ret != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) 
+            {
+                failed = true;
+            }
+            out.resize(out.size() - stream.avail_out);
+        }
+        deflateEnd(&stream);
+    };
+
+    vector<thread> workers;
+    for (unsigned t = 1; t < min<size_t>(threads, blockCount); ++t) 
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+    if (failed) 
+    {
+        throw runtime_error("parallel deflate failed");
+    }
+
+    uLong crc = crcs.empty() ? crc32(0, Z_NULL, 0) : crcs[0];
+    for (size_t block = 1; block < blockCount; ++block) 
+    {
+        size_t length = min(deflateBlockSize, data.size() - block * deflateBlockSize);
+        crc = crc32_combine(crc, crcs[block], z_off_t(length));
+    }
+
+    // gzip header (no name, no mtime, OS unknown), the blocks, then CRC-32 and size
+    string output("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    for (const string &block : compressed) 
+    {
+        output += block;
+    }
+    uint32_t isize = uint32_t(data.size());
+    for (uint32_t value : {uint32_t(crc), isize}) 
+    {
+        for (int shift = 0; shift < 32; shift += 8) 
+        {
+            output += char(value >> shift);
+        }
+    }
+    return output;
+}
+
+// Object write transaction. While one is open, writeObjectFile stages new
+// objects in .mygit/objects/incoming-<pid>-<n>/ instead of their final paths,
+// each through publishObjectFile so it is named only once complete.
+// commit() makes all staged data durable with a single syncfs(), hard-links
+// each object into place and then fsyncs the fanout directories it linked
+// into, so a crash never exposes a truncated object, the new names are
+// durable before the index or HEAD can refer to them, and the cost of the
+// barriers is paid once per command, not per object. Objects are not readable
+// under their final name until commit(); an uncommitted transaction is
+// discarded by the destructor.
+class ObjectTransaction 
+{
+public:
+    ObjectTransaction() 
+    {
+        static atomic<unsigned> sequence{0};
+        stagingDir = gitDir() / "objects" / ("incoming-" + to_string(getpid()) + "-" + to_string(sequence++));
+        previous = current;
+        current = this;
+    }
+
+    ~ObjectTransaction() 
+    {
+        if (current == this) 
+        {
+            current = previous;
+        }
+        error_code ignored;
+        remove_all(stagingDir, ignored);
+    }
+
+    ObjectTransaction(const ObjectTransaction &) = delete;
+    ObjectTransaction &operator=(const ObjectTransaction &) = delete;
+
+    // The innermost open transaction on this thread, or nullptr
+    static ObjectTransaction *active() 
+    {
+        return current;
+    }
+
+    // Make transaction the active one and return the one it replaces; a
+    // Repository uses this to bring its own transaction into each call
+    static ObjectTransaction *exchangeActive(ObjectTransaction *transaction) 
+    {
+        ObjectTransaction *replaced = current;
+        current = transaction;
+        return replaced;
+    }
+
+    // Claim sha for this transaction and return its staging path, or "" if it
+    // is already claimed here. The writer must report the outcome to finish().
+    path stage(const string &sha) 
+    {
+        lock_guard<mutex> guard(lock);
+        if (claimed.empty()) 
+        {
+            create_directories(stagingDir);
+        }
+        if (!claimed.insert(sha).second) 
+        {
+            return "";
+        }
+        return stagingDir / sha;
+    }
+
+    // Record whether the staged file for sha was completely written. A failed
+    // write is removed, and the transaction will then refuse to commit.
+    void finish(const string &sha, bool written) 
+    {
+        lock_guard<mutex> guard(lock);
+        if (written) 
+        {
+            staged.insert(sha);
+            return;
+        }
+        unlink((stagingDir / sha).c_str());
+        claimed.erase(sha);
+        failed = true;
+    }
+
+    // Flush every staged object with one barrier, then publish them all
+    bool commit() 
+    {
+        TraceSpan span("transaction.commit");
+        span.arg("objects", staged.size());
+        // Every claimed object must be complete, or what refers to a missing
+        // one could be published
+        if (failed || staged.size() != claimed.size()) 
+        {
+            reportError("Not every object could be written; nothing was published.");
+            return false;
+        }
+        if (staged.empty()) 
+        {
+            return true;
+        }
+
+        int dirFd = open(stagingDir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd < 0 || syncfs(dirFd) != 0) 
+        {
+            // Without syncfs fall back to fsyncing each staged object
+            for (const string &sha : staged) 
+            {
+                int fd = open((stagingDir / sha).c_str(), O_RDONLY);
+                if (fd >= 0) 
+                {
+                    fsync(fd);
+                    close(fd);
+                }
+            }
+        }
+        if (dirFd >= 0) 
+        {
+            close(dirFd);
+        }
+
+        bool ok = true;
+        set<path> touchedDirs{gitDir() / "objects"};
+        for (const string &sha : staged) 
+        {
+            path finalPath = objectFilePath(sha);
+            error_code ignored;
+            create_directories(finalPath.parent_path(), ignored);
+            touchedDirs.insert(finalPath.parent_path());
+            // link() never replaces an object another process published first
+            path stagedPath = stagingDir / sha;
+            if (link(stagedPath.c_str(), finalPath.c_str()) != 0 && errno != EEXIST) 
+            {
+                reportError("Failed to publish object " + sha + ": " + strerror(errno));
+                ok = false;
+            }
+        }
+
+        // Second barrier: the directory entries just created
+        for (const path &dir : touchedDirs) 
+        {
+            int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (fd < 0 || fsync(fd) != 0) 
+            {
+                reportError("Failed to sync " + dir.string() + ": " + strerror(errno));
+                ok = false;
+            }
+            if (fd >= 0) 
+            {
+                close(fd);
+            }
+        }
+        staged.clear();
+        claimed.clear();
+        return ok;
+    }
+
+private:
+    static inline thread_local ObjectTransaction *current = nullptr;
+    ObjectTransaction *previous;
+    path stagingDir;
+    mutex lock;
+    set<string> claimed;  // being written or written
+    set<string> staged;   // completely written
+    bool failed = false;
+};
+
+// True if stored bytes start with a gzip or zlib header (78 bb: zlib with a
+// preset dictionary); like zstr's reader, anything else is taken to be stored
+// uncompressed
+static bool looksCompressed(string_view stored) 
+{
+    if (stored.size() < 2) 
+    {
+        return false;
+    }
+    unsigned char b0 = stored[0], b1 = stored[1];
+    return (b0 == 0x1f && b1 == 0x8b) || (b0 == 0x78 && (b1 == 0x01 || b1 == 0x9c || b1 == 0xda || b1 == 0xbb));
+}
+
+// Preset dictionary: objects up to dictionaryObjectLimit bytes (trees,
+// commits, chunk lists, small files) are deflated as zlib streams primed with
+// a dictionary trained from the repository's own trees and commits
+// (train-dictionary), so the mode strings, header lines and committer names
+// every one of them repeats cost a back-reference instead of literals. A
+// dictionary is stored as .mygit/dictionaries/<id>, named by the Adler-32 ID
+// zlib puts in the stream header, and is never removed: objects written under
+// an older dictionary stay readable after retraining. dictionaries/current
+// holds the ID new objects use; without it objects are written as before.
+static const size_t dictionaryObjectLimit = 16 * 1024;
+
+static int64_t mtimeNanoseconds(const struct stat &fileStatus) 
+{
+    return int64_t(fileStatus.st_mtim.tv_sec) * 1000000000 + fileStatus.st_mtim.tv_nsec;
+}
+
+struct CurrentDictionary 
+{
+    path file;
+    ino_t inode = 0;
+    int64_t mtimeNs = 0;
+    uLong id = 0;
+    const string *bytes = nullptr;
+};
+
+static path dictionaryPath(uLong id) 
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%08lx", id);
+    return gitDir() / "dictionaries" / name;
+}
+
+// Dictionary id of the current repository, loaded once per process;
+// nullptr if it is missing or does not match its ID
+static const string *findDictionary(uLong id) 
+{
+    static mutex lock;
+    static map<string, string> loaded;  // node-based: entries never move
+    string file = dictionaryPath(id).string();
+    lock_guard<mutex> guard(lock);
+    auto found = loaded.find(file);
+    if (found != loaded.end()) 
+    {
+        return &found->second;
+    }
+    ifstream input(file, ios::binary);
+    if (!input) 
+    {
+        return nullptr;
+    }
+    ostringstream content;
+    content << input.rdbuf();
+    string bytes = content.str();
+    if (adler32(adler32(0, nullptr, 0), reinterpret_cast<const Bytef *>(bytes.data()), uInt(bytes.size())) != id) 
+    {
+        return nullptr;
+    }
+    return &loaded.emplace(file, move(bytes)).first->second;
+}
+
+// Let zstr readers inflate objects written with a dictionary
+static const bool dictionaryLookupInstalled = (zstr::dictionary_lookup = findDictionary, true);
+
+// Answer inflate()'s Z_NEED_DICT: Z_OK once the stream has its dictionary
+static int setInflateDictionary(z_stream &stream) 
+{
+    const string *dictionary = findDictionary(stream.adler);
+    if (!dictionary) 
+    {
+        return Z_DATA_ERROR;
+    }
+    return inflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary->data()), uInt(dictionary->size()));
+}
+
+// The dictionary new objects are written with, or nullptr; dictionaries/current
+// is re-read only when stat() shows it was replaced
+static const string *currentDictionary() 
+{
+    thread_local CurrentDictionary cache;
+    path file = gitDir() / "dictionaries" / "current";
+    struct stat fileStatus;
+    if (stat(file.c_str(), &fileStatus) != 0) 
+    {
+        return nullptr;
+    }
+    int64_t mtimeNs = mtimeNanoseconds(fileStatus);
+    if (cache.file != file || cache.inode != fileStatus.st_ino || cache.mtimeNs != mtimeNs) 
+    {
+        ifstream input(file);
+        string idText;
+        input >> idText;
+        cache.file = file;
+        cache.inode = fileStatus.st_ino;
+        cache.mtimeNs = mtimeNs;
+        cache.bytes = idText.size() == 8 ? findDictionary(strtoul(idText.c_str(), nullptr, 16)) : nullptr;
+    }
+    return cache.bytes;
+}
+
+// One deflate state per thread, reset rather than re-created for each object
+struct DictionaryDeflater 
+{
+    z_stream stream = {};
+    bool ready = false;
+
+    ~DictionaryDeflater() 
+    {
+        if (ready) 
+        {
+            deflateEnd(&stream);
+        }
+    }
+};
+
+// data as a zlib stream primed with dictionary. At the default level the
+// header is 78 bb, which looksCompressed recognises.
+static bool deflateWithDictionary(string_view data, const string &dictionary, string &packed) 
+{
+    thread_local DictionaryDeflater deflater;
+    z_stream &stream = deflater.stream;
+    if (!deflater.ready) 
+    {
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) 
+        {
+            return false;
+        }
+        deflater.ready = true;
+    } 
+    else 
+    {
+        deflateReset(&stream);
+    }
+    if (deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()), uInt(dictionary.size())) != Z_OK) 
+    {
+        return false;
+    }
+    packed.resize(deflateBound(&stream, uLong(data.size())));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&packed[0]);
+    stream.avail_out = uInt(packed.size());
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) 
+    {
+        return false;
+    }
+    packed.resize(stream.total_out);
+    return true;
+}
+
+// Store mode: an object that deflate can't shrink by at least 2% (already
+// compressed media, random data, tiny files) is written as is; readers take
+// anything without a gzip or zlib header to be stored raw, and checkout can
+// then copy it in the kernel. Objects above storeModeSample bytes are judged
+// from a deflated sample of their start, so incompressible data is never
+// compressed in full just to be thrown away.
+static const size_t storeModeSample = 64 * 1024;
+
+static bool deflateShrinks(size_t packedSize, size_t size) 
+{
+    return packedSize < size - size / 50;
+}
+
+// Whether sample deflates well enough to be worth compressing the whole
+static bool sampleCompresses(string_view sample) 
+{
+    thread_local vector<Bytef> packed;
+    uLongf packedSize = compressBound(uLong(sample.size()));
+    packed.resize(packedSize);
+    if (compress2(packed.data(), &packedSize, reinterpret_cast<const Bytef *>(sample.data()), uLong(sample.size()), Z_DEFAULT_COMPRESSION) != Z_OK) 
+    {
+        return true;
+    }
+    // zlib framing is 12 bytes smaller than the gzip framing objects use
+    return deflateShrinks(packedSize + 12, sample.size());
+}
+
+// The on-disk form of an object: a single gzip stream of its content
+string deflateObject(string_view data) 
+{
+    unsigned threads = workerCount();
+    if (data.size() >= parallelDeflateThreshold && threads > 1) 
+    {
+        return parallelDeflate(data, threads);
+    }
+    ostringstream packed;
+    {
+        zstr::ostream output(packed);
+        output << data;
+    }
+    return packed.str();
+}
+
+static bool writeAll(int fd, string_view bytes) 
+{
+    size_t done = 0;
+    while (done < bytes.size()) 
+    {
+        ssize_t written = write(fd, bytes.data() + done, bytes.size() - done);
+        if (written < 0) 
+        {
+            if (errno == EINTR) 
+            {
+                continue;
+            }
+            return false;
+        }
+        done += size_t(written);
+    }
+    return true;
+}
+
+// Create finalPath holding bytes without ever exposing a partial file. The
+// bytes go to an anonymous O_TMPFILE that linkat() names only once complete;
+// where O_TMPFILE or /proc is unavailable a named temporary is hard-linked
+// instead. Another writer having created the object first (EEXIST) counts as
+// success: object content is determined by its name.
+bool publishObjectFile(const path &finalPath, string_view bytes) 
+{
+    path dir = finalPath.parent_path();
+    error_code ignored;
+    create_directories(dir, ignored);
+
+    int fd = open(dir.c_str(), O_TMPFILE | O_WRONLY, 0444);
+    if (fd >= 0) 
+    {
+        bool ok = writeAll(fd, bytes);
+        if (ok) 
+        {
+            string procPath = "/proc/self/fd/" + to_string(fd);
+            ok = linkat(AT_FDCWD, procPath.c_str(), AT_FDCWD, finalPath.c_str(), AT_SYMLINK_FOLLOW) == 0 || errno == EEXIST;
+        }
+        close(fd);
+        if (ok) 
+        {
+            return true;
+        }
+    }
+
+    string tempPath = (dir / "tmp_obj_XXXXXX").string();
+    fd = mkstemp(&tempPath[0]);
+    if (fd < 0) 
+    {
+        return false;
+    }
+    bool ok = writeAll(fd, bytes) && fchmod(fd, 0444) == 0;
+    close(fd);
+    ok = ok && (link(tempPath.c_str(), finalPath.c_str()) == 0 || errno == EEXIST);
+    unlink(tempPath.c_str());
+    return ok;
+}
+
+// First bytes of a chunk-list object (see storeLargeFile)
+static const string chunkListMagic("\0MGCHNK\x01", 8);
+
+// A chunk list is told apart by how it is stored, not by its content: it is
+// always written raw, and any other object whose data starts with the magic is
+// always deflated. An object file whose stored bytes begin with the magic is
+// therefore a chunk list, and a blob holding the same bytes never is.
+static bool storedAsChunkList(const path &objectPath) 
+{
+    int fd = open(objectPath.c_str(), O_RDONLY);
+    if (fd < 0) 
+    {
+        return false;
+    }
+    char head[8];
+    ssize_t got = pread(fd, head, sizeof(head), 0);
+    close(fd);
+    return got == ssize_t(chunkListMagic.size()) && memcmp(head, chunkListMagic.data(), sizeof(head)) == 0;
+}
+
+// Compress and save data as object sha unless that object already exists;
+// false if it could not be written. A chunk list is stored raw.
+bool writeObjectFile(const string &sha, string_view data, bool chunkList = false) 
+{
+    TraceSpan span("object.write");
+    span.arg("sha", sha);
+    span.arg("size", data.size());
+
+    // An object that is already stored has its mtime freshened, so gc's grace
+    // period protects it until whatever is about to refer to it is written
+    path outputPath = objectFilePath(sha);
+    if (utimensat(AT_FDCWD, outputPath.c_str(), nullptr, 0) == 0 || (errno != ENOENT && errno != ENOTDIR)) 
+    {
+        span.arg("existing", 1);
+        return true;
+    }
+
+    ObjectTransaction *transaction = ObjectTransaction::active();
+    path stagedPath;
+    if (transaction) 
+    {
+        stagedPath = transaction->stage(sha);
+        if (stagedPath.empty()) 
+        {
+            span.arg("existing", 1);
+            return true;
+        }
+    }
+
+    // Data that starts like a compressed stream or a chunk list must be
+    // deflated, or readers would take it for one
+    bool mustDeflate = looksCompressed(data) || (!chunkList && data.substr(0, chunkListMagic.size()) == chunkListMagic);
+    string packed;
+    string_view stored = data;
+    if (!chunkList && (mustDeflate || data.size() <= storeModeSample || sampleCompresses(data.substr(0, storeModeSample)))) 
+    {
+        const string *dictionary = data.size() <= dictionaryObjectLimit ? currentDictionary() : nullptr;
+        bool primed = dictionary && deflateWithDictionary(data, *dictionary, packed);
+        if (!primed) 
+        {
+            packed = deflateObject(data);
+        }
+        span.arg("dictionary", primed);
+        if (mustDeflate || deflateShrinks(packed.size(), data.size())) 
+        {
+            stored = packed;
+        }
+    }
+    span.arg("raw", stored.data() == data.data());
+
+    bool ok;
+    if (transaction) 
+    {
+        ok = publishObjectFile(stagedPath, stored);
+        int savedErrno = errno;
+        transaction->finish(sha, ok);
+        errno = savedErrno;
+    } 
+    else 
+    {
+        ok = publishObjectFile(outputPath, stored);
+    }
+    if (!ok) 
+    {
+        reportError("Failed to write object " + sha + ": " + strerror(errno));
+    }
+    return ok;
+}
+
+// Compress and save data under its SHA-1, skipping objects that already
+// exist; "" if it could not be written
+string storeObject(string_view data) 
+{
+    string hashValue = generateSHA1FromData(data);
+    return writeObjectFile(hashValue, data) ? hashValue : "";
+}
+
+// Large files are split by content-defined chunking (FastCDC with a gear hash)
+// so an edit only changes the chunks around it. Each chunk is stored as an
+// ordinary blob; the file's own ID (the SHA-1 of its whole content) names a
+// chunk-list object:
+//
+//   "\0MGCHNK" 0x01 <total size: 8 bytes BE> <chunk count: 4 bytes BE>
+//   then per chunk: <id: 20 raw bytes> <size: 4 bytes BE>
+//
+// stored uncompressed (see storedAsChunkList).
+
+static const size_t minChunkSize = 256 * 1024;
+static const size_t avgChunkSize = 1024 * 1024;
+static const size_t maxChunkSize = 4 * 1024 * 1024;
+
+// Files at least this big are chunked; MYGIT_CHUNK_THRESHOLD overrides
+uintmax_t chunkThreshold() 
+{
+    const char *configured = getenv("MYGIT_CHUNK_THRESHOLD");
+    if (configured && *configured) 
+    {
+        return strtoull(configured, nullptr, 10);
+    }
+    return 16 * 1024 * 1024;
+}
+
+// Gear table from a fixed splitmix64 sequence; changing it would move every
+// chunk boundary and defeat deduplication against existing objects
+struct GearTable 
+{
+    uint64_t value[256];
+
+    GearTable() 
+    {
+        uint64_t state = 0x6d79676974ULL;
+        for (uint64_t &entry : value) 
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            entry = z ^ (z >> 31);
+        }
+    }
+};
+
+static const GearTable gearTable;
+
+// Length of the next chunk at the start of data (normalized chunking: a
+// stricter mask before the average size, a looser one after it)
+size_t nextChunkLength(const unsigned char *data, size_t length) 
+{
+    if (length <= minChunkSize) 
+    {
+        return length;
+    }
+    size_t limit = min(length, maxChunkSize);
+    size_t normal = min(limit, avgChunkSize);
+    // The gear hash shifts left, so the top bits see the most recent 64 bytes
+    const uint64_t maskStrict = ~uint64_t(0) << (64 - 22);
+    const uint64_t maskLoose = ~uint64_t(0) << (64 - 18);
+
+    uint64_t fingerprint = 0;
+    size_t i = minChunkSize;
+    for (; i < normal; i++) 
+    {
+        fingerprint = (fingerprint << 1) + gearTable.value[data[i]];
+        if (!(fingerprint & maskStrict)) 
+        {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++) 
+    {
+        fingerprint = (fingerprint << 1) + gearTable.value[data[i]];
+        if (!(fingerprint & maskLoose)) 
+        {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+// Hash a large file while streaming it; with saveToFile, store it as chunks
+// plus a chunk list. Memory stays bounded by a couple of maximum-size chunks.
+string storeLargeFile(istream &file, bool saveToFile) 
+{
+    TraceSpan span("chunk-file");
+    SHA_CTX fileHash;
+    SHA1_Init(&fileHash);
+
+    string chunkList;
+    uint64_t totalSize = 0;
+    uint32_t chunkCount = 0;
+    vector<char> buffer(2 * maxChunkSize);
+    size_t begin = 0, end = 0;
+    bool eof = false;
+    while (true) 
+    {
+        if (!eof && end - begin < maxChunkSize) 
+        {
+            // Slide what's left to the front and top the buffer up
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            file.read(buffer.data() + end, buffer.size() - end);
+            end += file.gcount();
+            eof = !file;
+        }
+        if (begin == end) 
+        {
+            break;
+        }
+
+        size_t length = saveToFile ? nextChunkLength(reinterpret_cast<unsigned char *>(buffer.data()) + begin, end - begin) : end - begin;
+        string_view chunk(buffer.data() + begin, length);
+        SHA1_Update(&fileHash, chunk.data(), chunk.size());
+        if (saveToFile) 
+        {
+            unsigned char entry[rawShaLength + 4];
+            if (!hexToSha(storeObject(chunk), entry)) 
+            {
+                return "";
+            }
+            entry[rawShaLength] = length >> 24;
+            entry[rawShaLength + 1] = length >> 16;
+            entry[rawShaLength + 2] = length >> 8;
+            entry[rawShaLength + 3] = length;
+            chunkList.append(reinterpret_cast<char *>(entry), sizeof(entry));
+            ++chunkCount;
+        }
+        totalSize += length;
+        begin += length;
+    }
+
+    unsigned char digest[rawShaLength];
+    SHA1_Final(digest, &fileHash);
+    string hashValue = shaToHex(digest);
+    span.arg("sha", hashValue);
+    span.arg("size", totalSize);
+    span.arg("chunks", chunkCount);
+
+    if (saveToFile) 
+    {
+        string header = chunkListMagic;
+        for (int shift = 56; shift >= 0; shift -= 8) 
+        {
+            header += char(totalSize >> shift);
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) 
+        {
+            header += char(chunkCount >> shift);
+        }
+        if (!writeObjectFile(hashValue, header + chunkList, true)) 
+        {
+            return "";
+        }
+    }
+    return hashValue;
+}
+
+// One chunk of a chunk-list object
+struct ChunkRef 
+{
+    unsigned char id[rawShaLength];
+    uint32_t size;
+};
+
+// Decode a chunk-list object; false if data is not one
+bool parseChunkList(string_view data, uint64_t &totalSize, vector<ChunkRef> &chunks) 
+{
+    if (data.size() < chunkListMagic.size() + 12 || data.substr(0, chunkListMagic.size()) != chunkListMagic) 
+    {
+        return false;
+    }
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data()) + chunkListMagic.size();
+    totalSize = 0;
+    for (int i = 0; i < 8; i++) 
+    {
+        totalSize = totalSize << 8 | bytes[i];
+    }
+    uint32_t count = uint32_t(bytes[8]) << 24 | uint32_t(bytes[9]) << 16 | uint32_t(bytes[10]) << 8 | bytes[11];
+    bytes += 12;
+    if (data.size() - chunkListMagic.size() - 12 != size_t(count) * (rawShaLength + 4)) 
+    {
+        return false;
+    }
+    chunks.resize(count);
+    for (ChunkRef &chunk : chunks) 
+    {
+        memcpy(chunk.id, bytes, rawShaLength);
+        chunk.size = uint32_t(bytes[rawShaLength]) << 24 | uint32_t(bytes[rawShaLength + 1]) << 16 |
+                     uint32_t(bytes[rawShaLength + 2]) << 8 | bytes[rawShaLength + 3];
+        bytes += rawShaLength + 4;
+    }
+    return true;
+}
+
+// The chunks of blob sha if it is a chunk list; only the first bytes of other
+// blobs are read
+bool readChunkList(const string &sha, vector<ChunkRef> &chunks, uint64_t *totalSize = nullptr) 
+{
+    if (sha.size() != 40) 
+    {
+        return false;
+    }
+    path objectPath = objectFilePath(sha);
+    if (!storedAsChunkList(objectPath)) 
+    {
+        return false;
+    }
+    ifstream objectFile(objectPath, ios::binary);
+    ostringstream content;
+    content << objectFile.rdbuf();
+    uint64_t size;
+    if (!parseChunkList(content.str(), size, chunks)) 
+    {
+        return false;
+    }
+    if (totalSize) 
+    {
+        *totalSize = size;
+    }
+    return true;
+}
+
+// Copy everything left in in to out through a fixed buffer
+intmax_t copyStream(istream &in, ostream &out) 
+{
+    char buffer[1 << 16];
+    intmax_t copied = 0;
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) 
+    {
+        out.write(buffer, in.gcount());
+        copied += in.gcount();
+    }
+    return copied;
+}
+
+// Inflate a blob into out, reassembling chunked blobs one chunk at a time.
+// Returns the number of bytes written, or -1 if an object is missing.
+intmax_t streamBlob(const string &sha, ostream &out) 
+{
+    if (sha.size() != 40) 
+    {
+        return -1;
+    }
+    path objectPath = objectFilePath(sha);
+    if (!exists(objectPath)) 
+    {
+        return -1;
+    }
+    if (!storedAsChunkList(objectPath)) 
+    {
+        zstr::ifstream objectFile(objectPath.string(), ios::binary);
+        return copyStream(objectFile, out);
+    }
+
+    vector<ChunkRef> chunks;
+    if (!readChunkList(sha, chunks)) 
+    {
+        return -1;
+    }
+    intmax_t written = 0;
+    for (const ChunkRef &chunk : chunks) 
+    {
+        TraceSpan span("object.read");
+        string chunkSha = shaToHex(chunk.id);
+        span.arg("sha", chunkSha);
+        span.arg("size", chunk.size);
+        path chunkPath = objectFilePath(chunkSha);
+        if (!exists(chunkPath)) 
+        {
+            return -1;
+        }
+        zstr::ifstream chunkFile(chunkPath.string(), ios::binary);
+        written += copyStream(chunkFile, out);
+    }
+    return written;
+}
+
+// Largest compressed size whose gzip ISIZE (the inflated size mod 2^32) must
+// be exact: deflate expands at most 1032:1
+static const uintmax_t isizeTrustLimit = 0xffffffffu / 1032;
+
+// Inflated size of blob sha (the reassembled size for a chunked file), or -1 if
+// it is missing. Small gzip objects are sized from their trailer; others need a
+// counting pass.
+intmax_t blobSize(const string &sha) 
+{
+    if (sha.size() != 40) 
+    {
+        return -1;
+    }
+    path objectPath = objectFilePath(sha);
+    error_code error;
+    uintmax_t storedSize = file_size(objectPath, error);
+    if (error) 
+    {
+        return -1;
+    }
+
+    ifstream rawFile(objectPath, ios::binary);
+    unsigned char head[16];
+    rawFile.read(reinterpret_cast<char *>(head), sizeof(head));
+    size_t got = size_t(rawFile.gcount());
+    rawFile.clear();
+    if (got == sizeof(head) && memcmp(head, chunkListMagic.data(), chunkListMagic.size()) == 0) 
+    {
+        uint64_t totalSize = 0;
+        for (size_t i = chunkListMagic.size(); i < sizeof(head); i++) 
+        {
+            totalSize = totalSize << 8 | head[i];
+        }
+        return intmax_t(totalSize);
+    }
+    if (!looksCompressed(string_view(reinterpret_cast<char *>(head), got))) 
+    {
+        return intmax_t(storedSize);  // stored raw
+    }
+    if (head[0] == 0x1f && head[1] == 0x8b && storedSize >= 18 && storedSize <= isizeTrustLimit) 
+    {
+        unsigned char trailer[4];
+        rawFile.seekg(-4, ios::end);
+        rawFile.read(reinterpret_cast<char *>(trailer), 4);
+        return intmax_t(uint32_t(trailer[0]) | uint32_t(trailer[1]) << 8 | uint32_t(trailer[2]) << 16 | uint32_t(trailer[3]) << 24);
+    }
+
+    zstr::ifstream objectFile(objectPath.string(), ios::binary);
+    char buffer[1 << 16];
+    intmax_t size = 0;
+    while (objectFile.read(buffer, sizeof(buffer)) || objectFile.gcount() > 0) 
+    {
+        size += objectFile.gcount();
+    }
+    return size;
+}
+
+
+// ID of a file's content without storing it: the file is streamed through
+// SHA-1 in a fixed per-thread buffer, so nothing is copied or allocated per
+// file. Chunked files get the same ID, which is the SHA-1 of the whole content.
+string hashFileContent(const string &filePath) 
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) 
+    {
+        reportError("Unable to open the specified file " + filePath);
+        return "";
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    thread_local vector<char> buffer(1024 * 1024);
+    SHA_CTX shaState;
+    SHA1_Init(&shaState);
+    ssize_t got;
+    while ((got = read(fd, buffer.data(), buffer.size())) != 0) 
+    {
+        if (got < 0) 
+        {
+            if (errno == EINTR) 
+            {
+                continue;
+            }
+            reportError("Could not read " + filePath + ": " + strerror(errno));
+            close(fd);
+            return "";
+        }
+        SHA1_Update(&shaState, buffer.data(), size_t(got));
+    }
+    close(fd);
+    unsigned char id[SHA_DIGEST_LENGTH];
+    SHA1_Final(id, &shaState);
+    return shaToHex(id);
+}
+
+string computeObjectHash(const string &inputFilePath, bool saveToFile = false) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return "";
+    }
+
+    TraceSpan span("file.read");
+    span.arg("path", inputFilePath);
+    if (!saveToFile) 
+    {
+        return hashFileContent(inputFilePath);
+    }
+    ifstream file(inputFilePath, ios::binary);
+    if (!file.is_open()) 
+    {
+        reportError("Unable to open the specified file " + inputFilePath);
+        return "";
+    }
+
+    // Large files are streamed (and chunked when stored) instead of read whole
+    error_code sizeError;
+    uintmax_t fileSize = file_size(inputFilePath, sizeError);
+    if (!sizeError && fileSize >= chunkThreshold()) 
+    {
+        span.arg("size", fileSize);
+        return storeLargeFile(file, saveToFile);
+    }
+
+    // Read straight into a buffer of the file's size rather than through a stream copy
+    string content;
+    if (!sizeError) 
+    {
+        content.resize(fileSize);
+        file.read(&content[0], fileSize);
+        content.resize(size_t(file.gcount()));
+    }
+    else 
+    {
+        ostringstream contentStream;
+        contentStream << file.rdbuf();
+        content = contentStream.str();
+    }
+    span.arg("size", content.size());
+    return storeObject(content);
+}
+
+// hash-object: print the ID of a file's content, storing it with write
+int hashObjectCommand(const string &filePath, bool write) 
+{
+    ObjectTransaction transaction;
+    string sha1_hash = computeObjectHash(filePath, write);
+    if (!transaction.commit()) 
+    {
+        return 1;
+    }
+    if (!sha1_hash.empty()) 
+    {
+        cout << "SHA-1 hash: " << sha1_hash << "\n";
+    }
+    return 0;
+}
+
+// hash-object --stdin-paths: hash (with write, also store) every path read
+// from in on MYGIT_THREADS threads and print one ID per line in input order.
+// Workers take the next path from a shared counter; the calling thread prints
+// each ID as soon as it and all before it are done. Stored objects go through
+// one transaction, and their IDs are printed only once it has committed.
+int hashObjectPaths(istream &in, bool write) 
+{
+    vector<string> paths;
+    string line;
+    while (getline(in, line)) 
+    {
+        if (!line.empty()) 
+        {
+            paths.push_back(line);
+        }
+    }
+    TraceSpan span("hash-object.batch");
+    span.arg("paths", paths.size());
+
+    ObjectTransaction transaction;
+    vector<string> ids(paths.size());
+    vector<char> done(paths.size(), 0);
+    mutex lock;
+    condition_variable ready;
+    atomic<size_t> next{0};
+    path repositoryDir = gitDir();
+    auto worker = [&]() 
+    {
+        // Per-thread state the calling thread set up
+        currentGitDir = repositoryDir;
+        ObjectTransaction::exchangeActive(write ? &transaction : nullptr);
+        for (size_t i; (i = next++) < paths.size();) 
+        {
+            // An exception must not escape the thread; the path is reported
+            // and gets no ID
+            string id;
+            try 
+            {
+                id = write ? computeObjectHash(paths[i], true) : hashFileContent(paths[i]);
+            } 
+            catch (const exception &e) 
+            {
+                reportError("Could not hash " + paths[i] + ": " + e.what());
+            }
+            {
+                lock_guard<mutex> guard(lock);
+                ids[i] = move(id);
+                done[i] = 1;
+            }
+            ready.notify_one();
+        }
+    };
+    unsigned threads = max(1u, min<unsigned>(workerCount(), unsigned(min<size_t>(paths.size(), UINT_MAX))));
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; ++t) 
+    {
+        workers.emplace_back(worker);
+    }
+
+    bool ok = true;
+    string out;
+    for (size_t i = 0; i < paths.size(); ++i) 
+    {
+        string id;
+        {
+            unique_lock<mutex> guard(lock);
+            ready.wait(guard, [&] { return done[i] != 0; });
+            id = move(ids[i]);
+        }
+        if (id.empty()) 
+        {
+            ok = false;  // the worker reported why
+            continue;
+        }
+        out += id;
+        out += '\n';
+        if (!write && out.size() >= 64 * 1024) 
+        {
+            cout.write(out.data(), out.size());
+            out.clear();
+        }
+    }
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+    if (!transaction.commit()) 
+    {
+        return 1;
+    }
+    cout.write(out.data(), out.size());
+    return ok ? 0 : 1;
+}
+
+// Read and inflate a whole object into data; false if it does not exist.
+// zlib is driven directly so no stream buffers are allocated, and data's
+// existing capacity is reused: callers that read many objects keep one buffer.
+bool readObject(const string &sha, string &data) 
+{
+    if (sha.size() != 40) 
+    {
+        return false;
+    }
+    char objectPath[PATH_MAX];
+    snprintf(objectPath, sizeof(objectPath), "%s/objects/%.2s/%s", gitDir().c_str(), sha.c_str(), sha.c_str() + 2);
+    int fd = open(objectPath, O_RDONLY);
+    if (fd < 0) 
+    {
+        return false;
+    }
+
+    TraceSpan span("object.read");
+    span.arg("sha", sha);
+    thread_local string stored;
+    struct stat fileStatus;
+    bool ok = fstat(fd, &fileStatus) == 0;
+    if (ok) 
+    {
+        stored.resize(size_t(fileStatus.st_size));
+        size_t done = 0;
+        while (ok && done < stored.size()) 
+        {
+            ssize_t got = read(fd, &stored[done], stored.size() - done);
+            ok = got > 0 || (got < 0 && errno == EINTR);
+            done += got > 0 ? size_t(got) : 0;
+        }
+    }
+    close(fd);
+    if (!ok) 
+    {
+        throw runtime_error("Could not read object " + sha);
+    }
+
+    if (!looksCompressed(stored)) 
+    {
+        data.assign(stored);
+        span.arg("size", data.size());
+        return true;
+    }
+
+    // Start from the gzip trailer's size when it can be trusted
+    size_t expected = stored.size() * 4;
+    if (stored[0] == '\x1f' && stored.size() >= 18 && stored.size() <= isizeTrustLimit) 
+    {
+        const unsigned char *trailer = reinterpret_cast<const unsigned char *>(stored.data()) + stored.size() - 4;
+        expected = size_t(trailer[0]) | size_t(trailer[1]) << 8 | size_t(trailer[2]) << 16 | size_t(trailer[3]) << 24;
+    }
+    data.resize(max<size_t>(expected, 64));
+
+    z_stream stream = {};
+    inflateInit2(&stream, 15 + 32);
+    stream.next_in = reinterpret_cast<Bytef *>(&stored[0]);
+    stream.avail_in = uInt(stored.size());
+    size_t produced = 0;
+    int ret = Z_OK;
+    while (ret == Z_OK) 
+    {
+        if (produced == data.size()) 
+        {
+            data.resize(data.size() * 2);
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(&data[produced]);
+        stream.avail_out = uInt(min<size_t>(data.size() - produced, UINT_MAX));
+        uInt before = stream.avail_out;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT && setInflateDictionary(stream) == Z_OK) 
+        {
+            ret = inflate(&stream, Z_NO_FLUSH);
+        }
+        produced += before - stream.avail_out;
+        if (ret == Z_BUF_ERROR && stream.avail_out == 0) 
+        {
+            ret = Z_OK;  // only out of room
+        }
+    }
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END) 
+    {
+        throw runtime_error("Corrupt object " + sha);
+    }
+    data.resize(produced);
+    span.arg("size", data.size());
+    return true;
+}
+
+// readObject for callers that report damage themselves: false if the object
+// is missing or cannot be inflated, instead of throwing
+static bool readIntactObject(const string &sha, string &data) 
+{
+    try 
+    {
+        return readObject(sha, data);
+    } 
+    catch (const exception &) 
+    {
+        return false;
+    }
+}
+
+// Open object sha if it is stored raw (not compressed, not a chunk list) and
+// set size; -1 otherwise
+static int openRawObject(const string &sha, uint64_t &size) 
+{
+    if (sha.size() != 40) 
+    {
+        return -1;
+    }
+    int fd = open(objectFilePath(sha).c_str(), O_RDONLY);
+    if (fd < 0) 
+    {
+        return -1;
+    }
+    char head[8];
+    ssize_t got = pread(fd, head, sizeof(head), 0);
+    string_view prefix(head, got > 0 ? size_t(got) : 0);
+    struct stat fileStatus;
+    if (got < 0 || fstat(fd, &fileStatus) != 0 || looksCompressed(prefix) || prefix == chunkListMagic) 
+    {
+        close(fd);
+        return -1;
+    }
+    size = uint64_t(fileStatus.st_size);
+    return fd;
+}
+
+// Append size bytes of in to out without passing them through user space: a
+// reflink of the whole file (FICLONE) when out is still empty and the
+// filesystem shares extents, else copy_file_range, which may reflink or copy
+// in the kernel. Falls back to read/write where neither is supported.
+static bool kernelCopy(int in, int out, uint64_t size, bool outEmpty) 
+{
+    if (outEmpty && size > 0 && ioctl(out, FICLONE, in) == 0) 
+    {
+        return lseek(out, 0, SEEK_END) >= 0;
+    }
+    off_t inOffset = 0;
+    while (size > 0) 
+    {
+        ssize_t copied = copy_file_range(in, &inOffset, out, nullptr, size_t(min<uint64_t>(size, 1u << 30)), 0);
+        if (copied < 0 && errno == EINTR) 
+        {
+            continue;
+        }
+        if (copied <= 0) 
+        {
+            break;
+        }
+        size -= uint64_t(copied);
+    }
+    thread_local vector<char> buffer(1024 * 1024);
+    while (size > 0) 
+    {
+        ssize_t got = pread(in, buffer.data(), size_t(min<uint64_t>(size, buffer.size())), inOffset);
+        if (got < 0 && errno == EINTR) 
+        {
+            continue;
+        }
+        if (got <= 0 || !writeAll(out, string_view(buffer.data(), size_t(got)))) 
+        {
+            return false;
+        }
+        inOffset += got;
+        size -= uint64_t(got);
+    }
+    return true;
+}
+
+// Write blob sha to target, returning its size or -1 if it is missing.
+// Raw-stored objects, and the raw chunks of a chunked file, are copied by
+// kernelCopy; compressed ones are inflated through user space.
+intmax_t materializeBlob(const string &sha, const path &target) 
+{
+    uint64_t size = 0;
+    int in = openRawObject(sha, size);
+    vector<ChunkRef> chunks;
+    if (in < 0 && !readChunkList(sha, chunks)) 
+    {
+        ofstream outputFile(target, ios::binary | ios::trunc);
+        intmax_t written = streamBlob(sha, outputFile);
+        outputFile.close();
+        if (written >= 0 && !outputFile) 
+        {
+            throw runtime_error("Could not write " + target.string());
+        }
+        return written;
+    }
+
+    int out = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) 
+    {
+        if (in >= 0) 
+        {
+            close(in);
+        }
+        throw runtime_error("Could not write " + target.string() + ": " + strerror(errno));
+    }
+    intmax_t total = -1;
+    if (in >= 0) 
+    {
+        total = kernelCopy(in, out, size, true) ? intmax_t(size) : -1;
+        close(in);
+    } 
+    else 
+    {
+        total = 0;
+        string chunkData;
+        for (const ChunkRef &chunk : chunks) 
+        {
+            string chunkSha = shaToHex(chunk.id);
+            uint64_t chunkSize = 0;
+            int chunkFd = openRawObject(chunkSha, chunkSize);
+            bool ok;
+            if (chunkFd >= 0) 
+            {
+                ok = kernelCopy(chunkFd, out, chunkSize, false);
+                close(chunkFd);
+            } 
+            else 
+            {
+                ok = readObject(chunkSha, chunkData) && writeAll(out, chunkData);
+                chunkSize = chunkData.size();
+            }
+            if (!ok) 
+            {
+                total = -1;
+                break;
+            }
+            total += intmax_t(chunkSize);
+        }
+    }
+    close(out);
+    if (total < 0) 
+    {
+        throw runtime_error("Could not write " + target.string());
+    }
+    return total;
+}
+
+// Tree objects. Version 1 is binary and canonical:
+//
+//   "\0MGTREE" 0x01, then per entry, sorted by name (byte order):
+//   <mode: 4 bytes big-endian> <id: 20 raw bytes> <name length: 2 bytes big-endian> <name>
+//
+// Trees written before the binary format are text, one "<mode> <type> <sha> <name>"
+// line per entry; TreeReader accepts both.
+static const string treeMagic("\0MGTREE\x01", 8);
+
+static const unsigned treeMode = 040000;
+
+// One tree entry; name points into the tree buffer being read
+struct TreeEntryView 
+{
+    unsigned mode = 0;
+    unsigned char id[rawShaLength];
+    string_view name;
+
+    bool isTree() const { return mode == treeMode; }
+    const char *type() const { return isTree() ? "tree" : "blob"; }
+    string sha() const { return shaToHex(id); }
+};
+
+// Walks the entries of an inflated tree object without allocating
+class TreeReader 
+{
+public:
+    explicit TreeReader(string_view treeData) 
+        : data(treeData), 
+          binary(treeData.substr(0, treeMagic.size()) == treeMagic),
+          pos(binary ? treeMagic.size() : 0)
+    {
+    }
+
+    bool next(TreeEntryView &entry) 
+    {
+        if (pos >= data.size()) 
+        {
+            return false;
+        }
+        bool ok = binary ? nextBinary(entry) : nextText(entry);
+        if (!ok) 
+        {
+            corrupt = true;
+            pos = data.size();
+        }
+        return ok;
+    }
+
+    // True if parsing stopped at a malformed entry
+    bool failed() const { return corrupt; }
+
+private:
+    bool nextBinary(TreeEntryView &entry) 
+    {
+        if (data.size() - pos < 4 + rawShaLength + 2) 
+        {
+            return false;
+        }
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data()) + pos;
+        entry.mode = unsigned(bytes[0]) << 24 | unsigned(bytes[1]) << 16 | unsigned(bytes[2]) << 8 | bytes[3];
+        memcpy(entry.id, bytes + 4, rawShaLength);
+        size_t nameLength = size_t(bytes[4 + rawShaLength]) << 8 | bytes[5 + rawShaLength];
+        pos += 4 + rawShaLength + 2;
+        if (data.size() - pos < nameLength) 
+        {
+            return false;
+        }
+        entry.name = data.substr(pos, nameLength);
+        pos += nameLength;
+        return true;
+    }
+
+    bool nextText(TreeEntryView &entry) 
+    {
+        size_t end = data.find('\n', pos);
+        string_view line = data.substr(pos, end == string_view::npos ? string_view::npos : end - pos);
+        pos = (end == string_view::npos) ? data.size() : end + 1;
+
+        // <mode> <type> <sha> <name>; the name may contain spaces
+        size_t first = line.find(' ');
+        size_t second = (first == string_view::npos) ? first : line.find(' ', first + 1);
+        size_t third = (second == string_view::npos) ? second : line.find(' ', second + 1);
+        if (third == string_view::npos || !hexToSha(line.substr(second + 1, third - second - 1), entry.id)) 
+        {
+            return false;
+        }
+        entry.mode = 0;
+        for (char c : line.substr(0, first)) 
+        {
+            entry.mode = entry.mode * 8 + (c - '0');
+        }
+        entry.name = line.substr(third + 1);
+        return true;
+    }
+
+    string_view data;
+    bool binary;
+    size_t pos;
+    bool corrupt = false;
+};
+
+// Encode entries as a version 1 tree object, sorted by name
+string serializeTree(vector<TreeItem> &items) 
+{
+    sort(items.begin(), items.end(), [](const TreeItem &a, const TreeItem &b) { return a.name < b.name; });
+
+    string treeData = treeMagic;
+    for (const TreeItem &item : items) 
+    {
+        unsigned char header[4 + rawShaLength + 2];
+        header[0] = item.mode >> 24;
+        header[1] = item.mode >> 16;
+        header[2] = item.mode >> 8;
+        header[3] = item.mode;
+        hexToSha(item.sha, header + 4);
+        header[4 + rawShaLength] = item.name.size() >> 8;
+        header[5 + rawShaLength] = item.name.size();
+        treeData.append(reinterpret_cast<const char *>(header), sizeof(header));
+        treeData += item.name;
+    }
+    return treeData;
+}
+
+// Six-digit octal mode as shown by ls-tree ("100644", "040000")
+string formatMode(unsigned mode) 
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%06o", mode);
+    return buffer;
+}
+
+// Print a tree's entries as "<mode> <type> <sha> <name>" (or just names)
+bool printTree(const string &treeData, bool showNamesOnly) 
+{
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        if (showNamesOnly) 
+        {
+            cout << entry.name << "\n";
+        } else 
+        {
+            char hex[rawShaLength * 2];
+            shaToHex(entry.id, hex);
+            char mode[8];
+            snprintf(mode, sizeof(mode), "%06o", entry.mode);
+            cout << mode << " " << entry.type() << " ";
+            cout.write(hex, sizeof(hex));
+            cout << " " << entry.name << "\n";
+        }
+    }
+    if (reader.failed()) 
+    {
+        cerr << "Error: Corrupt tree object.\n";
+        return false;
+    }
+    return true;
+}
+
+// Commit objects are text: "tree <sha>", an optional "parent <sha>", then
+// "Committer", "Timestamp" and "Message" lines, ended by a blank line or the
+// end of the object. A CommitView points into the inflated buffer, so parsing
+// allocates nothing; the buffer must outlive the view.
+struct CommitView 
+{
+    string_view tree;
+    string_view parent;
+    string_view committer;
+    string_view timestamp;
+    string_view message;
+};
+
+// False if data doesn't start like a commit
+bool parseCommit(string_view data, CommitView &view) 
+{
+    view = CommitView();
+    if (data.substr(0, 5) != "tree ") 
+    {
+        return false;
+    }
+    static const pair<string_view, string_view CommitView::*> fields[] = {
+        {"tree ", &CommitView::tree},
+        {"parent ", &CommitView::parent},
+        {"Committer ", &CommitView::committer},
+        {"Timestamp ", &CommitView::timestamp},
+        {"Message ", &CommitView::message},
+    };
+    const char *pos = data.data();
+    const char *end = pos + data.size();
+    while (pos < end) 
+    {
+        const char *eol = static_cast<const char *>(memchr(pos, '\n', size_t(end - pos)));
+        string_view line(pos, size_t((eol ? eol : end) - pos));
+        if (line.empty()) 
+        {
+            break;
+        }
+        for (const auto &[key, field] : fields) 
+        {
+            if (line.substr(0, key.size()) == key) 
+            {
+                view.*field = line.substr(key.size());
+                break;
+            }
+        }
+        pos = eol ? eol + 1 : end;
+    }
+    return true;
+}
+
+void showFile(const string &argument, const string &sha1Hash) 
+{
+    path myGitFolder = gitDir();
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+
+    path objectFilePath = myGitFolder / "objects" / sha1Hash.substr(0, 2) / sha1Hash.substr(2);
+    if (!exists(objectFilePath)) 
+    {
+        cerr << "Error: Unable to locate the object with SHA-1 " << sha1Hash << ".\n";
+        return;
+    }
+
+    if (argument == "-p") 
+    {  
+        zstr::ifstream fileStream(objectFilePath, ios::binary);
+        if (fileStream.is_open()) 
+        {
+            // Binary trees are listed like ls-tree; blobs are streamed, chunked ones reassembled
+            string head(treeMagic.size(), '\0');
+            fileStream.read(&head[0], head.size());
+            head.resize(fileStream.gcount());
+            fileStream.clear();
+            if (head == treeMagic) 
+            {
+                ostringstream rest;
+                rest << fileStream.rdbuf();
+                printTree(head + rest.str(), false);
+                return;
+            }
+            fileStream.close();
+            if (streamBlob(sha1Hash, cout) < 0) 
+            {
+                cerr << "Error: Cannot read the content of the file.\n";
+                return;
+            }
+            cout << "\n";
+        } 
+        else 
+        {
+            cerr << "Error: Cannot read the content of the file.\n";
+        }
+    } 
+    else if (argument == "-s") 
+    {  
+
+        cout << "Size of the file: " << file_size(objectFilePath) << " bytes\n";
+    } 
+    else if (argument == "-t") 
+    {   
+
+        zstr::ifstream fileStream(objectFilePath, ios::binary);
+        if (!fileStream.is_open()) 
+        {
+            cerr << "Error: Cannot read the content of the file.\n";
+            return;
+        }
+
+        // Read the first few bytes to check the format
+        string content;
+        getline(fileStream, content);
+
+        // Check if the content matches the tree format
+        // Tree format typically starts with a file mode (like 100644 or 040000)
+        // followed by type and hash
+        bool isTree = content.compare(0, treeMagic.size(), treeMagic) == 0;
+        istringstream iss(content);
+        string firstWord;
+        if (iss >> firstWord) 
+        {
+            // Check if the first word is a valid file mode (6 digits)
+            if (firstWord.length() == 6 && all_of(firstWord.begin(), firstWord.end(), ::isdigit)) 
+            {
+                isTree = true;
+            }
+        }
+
+        cout << "Type of the object: " << (isTree ? "tree" : "blob") << "\n";
+    } 
+    else 
+    {
+        cerr << "Error: Invalid argument. Use '-p', '-s', or '-t'.\n";
+    }
+}
+
+// Function to check if a file has executable permissions
+bool checkIfExecutable(const string &fileName) 
+{
+    struct stat fileStatus;
+    if (stat(fileName.c_str(), &fileStatus) != 0) 
+    {
+        return false; 
+    }
+    return (fileStatus.st_mode & S_IXUSR) != 0; 
+}
+
+// Index entry: a staged file with its blob SHA and mode
+struct IndexEntry 
+{
+    string mode;
+    string sha;
+    int64_t mtimeNs = 0;  // stat data when staged; size -1 means unknown
+    int64_t size = -1;
+};
+
+// Cache-tree node: tree SHA and number of index entries below a staged directory
+struct CacheTreeNode 
+{
+    long entryCount = 0;
+    string sha;
+};
+
+// The staging area. Entries are keyed by repo-relative path, cache-tree nodes by
+// directory ("" is the root). A directory without a node has been invalidated.
+struct Index 
+{
+    map<string, IndexEntry> entries;
+    map<string, CacheTreeNode> cacheTree;
+    int64_t fileMtimeNs = 0;  // mtime of .mygit/index when it was read
+};
+
+static const string indexHeader = "MYGITINDEX 3";
+
+// Remember a file's stat data so status can skip re-hashing it while unchanged
+void recordStat(IndexEntry &entry, const struct stat &fileStatus) 
+{
+    entry.mtimeNs = mtimeNanoseconds(fileStatus);
+    entry.size = fileStatus.st_size;
+}
+
+// Turn a user-supplied path into the form stored in the index ("dir/file")
+string indexPathFor(const path &filePath) 
+{
+    path rel = filePath.is_absolute() ? relative(filePath) : filePath;
+    string result = rel.lexically_normal().generic_string();
+    if (result == ".") 
+    {
+        return "";
+    }
+    while (!result.empty() && result.back() == '/') 
+    {
+        result.pop_back();
+    }
+    return result;
+}
+
+// A whole index field as a number; false if any of it is not
+template <typename Number>
+static bool parseIndexNumber(string_view field, Number &value) 
+{
+    auto [end, error] = from_chars(field.data(), field.data() + field.size(), value);
+    return error == errc() && end == field.data() + field.size();
+}
+
+string headCommitSha();
+string commitTreeSha(const string &commitSha);
+long readTreeIntoIndex(Index &index, const string &treeSha, const string &dirPath);
+void invalidateCacheTree(Index &index, const string &filePath);
+bool unstagePath(Index &index, const string &filePath);
+
+// Read .mygit/index; legacy "<sha> <path>" lines are upgraded on the fly.
+// Before the header existed, commit emptied the index, so a legacy index only
+// holds what was added since: it is applied on top of HEAD's tree, minus the
+// .mygit directory that commits of that era swept into the tree.
+bool readIndex(Index &index) 
+{
+    TraceSpan span("index.read");
+    ifstream index_file(gitDir() / "index", ios::binary);
+    if (!index_file.is_open()) 
+    {
+        cerr << "Error: Could not open index file.\n";
+        return false;
+    }
+
+    struct stat indexStatus;
+    if (stat((gitDir() / "index").c_str(), &indexStatus) == 0) 
+    {
+        index.fileMtimeNs = mtimeNanoseconds(indexStatus);
+    }
+
+    auto startFromHead = [&]() 
+    {
+        string headSha = headCommitSha();
+        string treeSha = headSha.empty() ? "" : commitTreeSha(headSha);
+        if (treeSha.empty()) 
+        {
+            return true;
+        }
+        try 
+        {
+            readTreeIntoIndex(index, treeSha, "");
+            unstagePath(index, ".mygit");
+            return true;
+        } 
+        catch (const exception &e) 
+        {
+            cerr << "Error: Cannot upgrade the index from HEAD: " << e.what() << "\n";
+            return false;
+        }
+    };
+
+    string line;
+    bool inCacheTree = false;
+    bool legacy = true;
+    int version = 0;
+    bool firstLine = true;
+    while (getline(index_file, line)) 
+    {
+        if (firstLine) 
+        {
+            firstLine = false;
+            if (line == "MYGITINDEX 2" || line == indexHeader) 
+            {
+                legacy = false;
+                version = line.back() - '0';
+                continue;
+            }
+            if (!startFromHead()) 
+            {
+                return false;
+            }
+        }
+        if (line.empty()) 
+        {
+            continue;
+        }
+        if (!legacy && line == "TREE") 
+        {
+            inCacheTree = true;
+            continue;
+        }
+
+        if (inCacheTree) 
+        {
+            // <entry count> <tree sha> <dir>/
+            size_t first = line.find(' ');
+            size_t second = line.find(' ', first + 1);
+            if (first == string::npos || second == string::npos || line.back() != '/') 
+            {
+                continue;
+            }
+            CacheTreeNode node;
+            if (!parseIndexNumber(string_view(line).substr(0, first), node.entryCount)) 
+            {
+                continue;
+            }
+            node.sha = line.substr(first + 1, second - first - 1);
+            index.cacheTree[line.substr(second + 1, line.size() - second - 2)] = node;
+        } 
+        else if (legacy) 
+        {
+            // <sha> <path>; later lines for the same path win
+            size_t space_pos = line.find(' ');
+            if (space_pos == string::npos) 
+            {
+                continue;
+            }
+            string filePath = indexPathFor(line.substr(space_pos + 1));
+            IndexEntry entry;
+            entry.sha = line.substr(0, space_pos);
+            entry.mode = checkIfExecutable(filePath) ? "100755" : "100644";
+            index.entries[filePath] = entry;
+            invalidateCacheTree(index, filePath);
+        } 
+        else 
+        {
+            // <mode> <sha> [<mtime ns> <size>] <path>; version 2 has no stat data
+            size_t fields[4];
+            int fieldCount = (version >= 3) ? 4 : 2;
+            size_t pos = 0;
+            bool complete = true;
+            for (int i = 0; i < fieldCount && complete; i++) 
+            {
+                fields[i] = line.find(' ', pos);
+                complete = fields[i] != string::npos;
+                pos = fields[i] + 1;
+            }
+            if (!complete) 
+            {
+                continue;
+            }
+            IndexEntry entry;
+            entry.mode = line.substr(0, fields[0]);
+            entry.sha = line.substr(fields[0] + 1, fields[1] - fields[0] - 1);
+            string filePath = line.substr(fields[fieldCount - 1] + 1);
+            string_view text(line);
+            if (version >= 3 && (!parseIndexNumber(text.substr(fields[1] + 1, fields[2] - fields[1] - 1), entry.mtimeNs) ||
+                                 !parseIndexNumber(text.substr(fields[2] + 1, fields[3] - fields[2] - 1), entry.size))) 
+            {
+                // Stat data is only a cache: keep the entry, but make status hash the file
+                cerr << "Error: Ignoring malformed stat data for " << filePath << " in the index.\n";
+                entry.mtimeNs = 0;
+                entry.size = -1;
+            }
+            index.entries[filePath] = entry;
+        }
+    }
+    return !firstLine || startFromHead();
+}
+
+// The right to rewrite the index: .mygit/index.lock, created with O_EXCL like
+// a ref's lock. A command takes it before reading the index it will rewrite,
+// so concurrent writers queue up instead of overwriting each other's changes.
+// A busy lock is retried for up to indexLockPatience. The lock file is removed
+// again unless writeIndex renamed it over the index.
+static const chrono::seconds indexLockPatience(10);
+
+class IndexLock 
+{
+public:
+    IndexLock() = default;
+    IndexLock(const IndexLock &) = delete;
+    IndexLock &operator=(const IndexLock &) = delete;
+
+    ~IndexLock() 
+    {
+        release();
+    }
+
+    // Without wait a busy lock fails at once and silently
+    bool acquire(bool wait = true) 
+    {
+        path wanted = gitDir() / "index.lock";
+        auto deadline = chrono::steady_clock::now() + indexLockPatience;
+        chrono::milliseconds delay(1);
+        while ((fd = open(wanted.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0) 
+        {
+            if (errno != EEXIST || !wait || chrono::steady_clock::now() >= deadline) 
+            {
+                if (wait) 
+                {
+                    cerr << "Error: Unable to lock the index: " << strerror(errno)
+                         << ". If no other mygit command is running, remove " << wanted.string() << ".\n";
+                }
+                return false;
+            }
+            this_thread::sleep_for(delay);
+            delay = min(delay * 2, chrono::milliseconds(50));
+        }
+        lockPath = wanted;
+        return true;
+    }
+
+    // Write bytes to the lock file, make them durable and rename it over the index
+    bool publish(string_view bytes) 
+    {
+        bool ok = writeAll(fd, bytes) && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        fd = -1;
+        ok = ok && ::rename(lockPath.c_str(), (gitDir() / "index").c_str()) == 0;
+        if (!ok) 
+        {
+            cerr << "Error: Could not write index file: " << strerror(errno) << "\n";
+            unlink(lockPath.c_str());
+        }
+        lockPath.clear();
+        return ok;
+    }
+
+    void release() 
+    {
+        if (fd >= 0) 
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (!lockPath.empty()) 
+        {
+            unlink(lockPath.c_str());
+            lockPath.clear();
+        }
+    }
+
+private:
+    int fd = -1;
+    path lockPath;
+};
+
+// Write the index through the lock the caller took before reading it
+bool writeIndex(const Index &index, IndexLock &lock) 
+{
+    TraceSpan span("index.write");
+    span.arg("entries", index.entries.size());
+    string out = indexHeader + "\n";
+    for (const auto &[filePath, entry] : index.entries) 
+    {
+        out += entry.mode + " " + entry.sha + " " + to_string(entry.mtimeNs) + " " + to_string(entry.size) + " " + filePath + "\n";
+    }
+    if (!index.cacheTree.empty()) 
+    {
+        out += "TREE\n";
+        for (const auto &[dirPath, node] : index.cacheTree) 
+        {
+            out += to_string(node.entryCount) + " " + node.sha + " " + dirPath + "/\n";
+        }
+    }
+    return lock.publish(out);
+}
+
+// A sparse checkout stages each subtree outside the cone as one entry holding
+// the subtree's ID instead of reading it
+static bool isSparseDirectory(const IndexEntry &entry) 
+{
+    return entry.mode == "040000";
+}
+
+// Record stat data for entries whose files were just written from their blobs
+void refreshStat(Index &index) 
+{
+    struct stat fileStatus;
+    for (auto &[filePath, entry] : index.entries) 
+    {
+        if (!isSparseDirectory(entry) && stat(filePath.c_str(), &fileStatus) == 0) 
+        {
+            recordStat(entry, fileStatus);
+        }
+    }
+}
+
+// Drop the cached tree of every directory containing filePath
+void invalidateCacheTree(Index &index, const string &filePath) 
+{
+    size_t slash = filePath.rfind('/');
+    while (slash != string::npos) 
+    {
+        index.cacheTree.erase(filePath.substr(0, slash));
+        slash = (slash == 0) ? string::npos : filePath.rfind('/', slash - 1);
+    }
+    index.cacheTree.erase("");
+}
+
+// Replace any sparse directory entry above filePath with the files of its
+// tree, so that staging or removing filePath keeps its siblings
+static void expandSparseParents(Index &index, const string &filePath) 
+{
+    for (size_t slash = filePath.find('/'); slash != string::npos; slash = filePath.find('/', slash + 1)) 
+    {
+        string dirPath = filePath.substr(0, slash);
+        auto parent = index.entries.find(dirPath);
+        if (parent != index.entries.end() && isSparseDirectory(parent->second)) 
+        {
+            string treeSha = parent->second.sha;
+            index.entries.erase(parent);
+            readTreeIntoIndex(index, treeSha, dirPath);
+            return;
+        }
+    }
+}
+
+// Remove a path (and everything staged below it) from the index
+bool unstagePath(Index &index, const string &filePath) 
+{
+    expandSparseParents(index, filePath);
+    bool removed = false;
+    auto it = index.entries.lower_bound(filePath);
+    while (it != index.entries.end()) 
+    {
+        const string &key = it->first;
+        bool below = key.size() > filePath.size() && key.compare(0, filePath.size(), filePath) == 0 && key[filePath.size()] == '/';
+        if (key != filePath && !below && !filePath.empty()) 
+        {
+            break;
+        }
+        invalidateCacheTree(index, key);
+        it = index.entries.erase(it);
+        removed = true;
+    }
+    return removed;
+}
+
+// Stage a file; returns false when the index already held the same entry
+bool stageEntry(Index &index, const string &filePath, const string &sha, const string &mode, const struct stat *fileStatus = nullptr) 
+{
+    auto it = index.entries.find(filePath);
+    if (it != index.entries.end() && it->second.sha == sha && it->second.mode == mode) 
+    {
+        if (fileStatus) 
+        {
+            recordStat(it->second, *fileStatus);
+        }
+        return false;
+    }
+    // A file replaces a staged directory of the same name and the other way round
+    unstagePath(index, filePath);
+    for (size_t slash = filePath.find('/'); slash != string::npos; slash = filePath.find('/', slash + 1)) 
+    {
+        auto parent = index.entries.find(filePath.substr(0, slash));
+        if (parent != index.entries.end()) 
+        {
+            index.entries.erase(parent);
+        }
+    }
+
+    IndexEntry &entry = index.entries[filePath];
+    entry = IndexEntry{mode, sha};
+    if (fileStatus) 
+    {
+        recordStat(entry, *fileStatus);
+    }
+    invalidateCacheTree(index, filePath);
+    return true;
+}
+
+using IndexRange = vector<map<string, IndexEntry>::const_iterator>;
+
+// First position in [from, to) whose path is not below prefix
+static size_t endOfPrefix(const IndexRange &sorted, size_t from, size_t to, const string &prefix) 
+{
+    // Paths below "dir/" all sort before "dir0" ('0' follows '/')
+    string limit = prefix;
+    limit.back() = '/' + 1;
+    auto it = lower_bound(sorted.begin() + from, sorted.begin() + to, limit,
+                          [](const map<string, IndexEntry>::const_iterator &e, const string &key) { return e->first < key; });
+    return it - sorted.begin();
+}
+
+// Write the tree for sorted[from, to), all of which live below dirPath
+static string writeTreeRange(Index &index, const IndexRange &sorted, size_t from, size_t to, const string &dirPath) 
+{
+    auto cached = index.cacheTree.find(dirPath);
+    if (cached != index.cacheTree.end() && cached->second.entryCount == long(to - from)) 
+    {
+        return cached->second.sha;
+    }
+
+    string prefix = dirPath.empty() ? "" : dirPath + "/";
+    vector<TreeItem> items;
+
+    size_t i = from;
+    while (i < to) 
+    {
+        const string &filePath = sorted[i]->first;
+        string rest = filePath.substr(prefix.size());
+        size_t slash = rest.find('/');
+        if (slash == string::npos) 
+        {
+            const IndexEntry &entry = sorted[i]->second;
+            items.push_back(TreeItem{unsigned(stoul(entry.mode, nullptr, 8)), entry.sha, rest});
+            ++i;
+            continue;
+        }
+
+        string entryName = rest.substr(0, slash);
+        string subDir = prefix + entryName;
+        size_t subEnd = endOfPrefix(sorted, i, to, subDir + "/");
+        string subSha = writeTreeRange(index, sorted, i, subEnd, subDir);
+        items.push_back(TreeItem{treeMode, subSha, entryName});
+        i = subEnd;
+    }
+
+    string treeSHA1 = storeObject(serializeTree(items));
+    index.cacheTree[dirPath] = CacheTreeNode{long(to - from), treeSHA1};
+    return treeSHA1;
+}
+
+// Build tree objects from the staged entries, rewriting only invalidated directories
+string buildTree(Index &index) 
+{
+    TraceSpan span("write-tree");
+    IndexRange sorted;
+    sorted.reserve(index.entries.size());
+    for (auto it = index.entries.begin(); it != index.entries.end(); ++it) 
+    {
+        sorted.push_back(it);
+    }
+    return writeTreeRange(index, sorted, 0, sorted.size(), "");
+}
+
+// write-tree: store the index as trees and print the root tree's ID
+int writeTreeCommand() 
+{
+    IndexLock lock;
+    Index index;
+    if (!lock.acquire() || !readIndex(index)) 
+    {
+        return 1;
+    }
+    ObjectTransaction transaction;
+    string tree_sha1 = buildTree(index);
+    if (!transaction.commit()) 
+    {
+        return 1;
+    }
+    writeIndex(index, lock);
+    if(tree_sha1!="")
+    {
+        cout << "Tree SHA-1: " << tree_sha1 << "\n";
+    }
+    return 0;
+}
+
+// Replace the index with the contents of a tree; every directory's cache is valid afterwards
+long readTreeIntoIndex(Index &index, const string &treeSha, const string &dirPath) 
+{
+    string treeData;
+    if (!readObject(treeSha, treeData)) 
+    {
+        throw runtime_error("Tree object not found: " + treeSha);
+    }
+
+    string prefix = dirPath.empty() ? "" : dirPath + "/";
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    long entryCount = 0;
+    while (reader.next(entry)) 
+    {
+        string entryPath = prefix;
+        entryPath += entry.name;
+
+        if (entry.isTree()) 
+        {
+            entryCount += readTreeIntoIndex(index, entry.sha(), entryPath);
+        } 
+        else 
+        {
+            index.entries[entryPath] = IndexEntry{formatMode(entry.mode), entry.sha()};
+            ++entryCount;
+        }
+    }
+    if (reader.failed()) 
+    {
+        throw runtime_error("Corrupt tree object: " + treeSha);
+    }
+    index.cacheTree[dirPath] = CacheTreeNode{entryCount, treeSha};
+    return entryCount;
+}
+
+void listTreeContents(const string &sha, bool showNamesOnly) 
+{
+    path myGitFolder = gitDir();
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+    if (sha.size() != 40) 
+    {
+        cerr << "Error: Invalid SHA-1 hash provided.\n";
+        return;
+    }
+
+    path objectPath = objectFilePath(sha);
+
+    if (!exists(objectPath)) 
+    {
+        cerr << "Error: Object with SHA-1 " << sha << " not found.\n";
+        return;
+    }
+
+    string treeData;
+    if (!readObject(sha, treeData)) 
+    {
+        cerr << "Error: Could not open the object file.\n";
+        return;
+    }
+
+    // Directly list tree contents
+    printTree(treeData, showNamesOnly);
+}
+
+
+
+// Sparse checkout. .mygit/info/sparse-checkout lists the directories (or
+// single files) to materialize, one path per line from the top of the
+// worktree; blank lines and lines starting with '#' are ignored, and "/" or
+// "*" selects everything. Without the file the whole tree is checked out.
+// Index entries outside the cone are kept, so commits still carry them, but
+// their absence from the worktree is not reported or staged as a deletion.
+// A checkout stages each subtree outside the cone as a single sparse
+// directory entry, so those trees are never read; staging a path inside one
+// expands it.
+class SparseCone 
+{
+public:
+    SparseCone() = default;
+
+    explicit SparseCone(const vector<string> &patterns) 
+    {
+        for (string pattern : patterns) 
+        {
+            pattern.erase(0, pattern.find_first_not_of('/'));
+            pattern = indexPathFor(pattern);
+            if (pattern.empty() || pattern == "*") 
+            {
+                paths.clear();
+                break;
+            }
+            paths.push_back(pattern);
+        }
+        matched.assign(paths.size(), false);
+    }
+
+    bool everything() const { return paths.empty(); }
+
+    // True if filePath is listed or lies inside a listed directory
+    bool includes(const string &filePath) const 
+    {
+        return everything() || any_of(paths.begin(), paths.end(), [&](const string &listed) { return isWithin(filePath, listed); });
+    }
+
+    // includes(), also remembering which listed paths matched
+    bool claim(const string &filePath) 
+    {
+        bool found = everything();
+        for (size_t i = 0; i < paths.size(); ++i) 
+        {
+            if (isWithin(filePath, paths[i])) 
+            {
+                matched[i] = true;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // True if dirPath holds anything in the cone, so it is worth descending
+    bool leadsTo(const string &dirPath) const 
+    {
+        if (everything()) 
+        {
+            return true;
+        }
+        for (const string &listed : paths) 
+        {
+            if (isWithin(dirPath, listed) || isWithin(listed, dirPath)) 
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Listed paths that no claim() has matched yet
+    vector<string> unmatched() const 
+    {
+        vector<string> result;
+        for (size_t i = 0; i < paths.size(); ++i) 
+        {
+            if (!matched[i]) 
+            {
+                result.push_back(paths[i]);
+            }
+        }
+        return result;
+    }
+
+private:
+    static bool isWithin(const string &inner, const string &outer) 
+    {
+        return inner.compare(0, outer.size(), outer) == 0 && (inner.size() == outer.size() || inner[outer.size()] == '/');
+    }
+
+    vector<string> paths;
+    vector<bool> matched;
+};
+
+struct SparseConeCache 
+{
+    path file;
+    ino_t inode = 0;
+    off_t size = -1;
+    int64_t mtimeNs = 0;
+    SparseCone cone;
+};
+
+// The cone from the current repository's info/sparse-checkout, valid until
+// the next call; the file is re-read only when stat() shows it was replaced
+const SparseCone &sparseCone() 
+{
+    thread_local SparseConeCache cache;
+    path file = gitDir() / "info" / "sparse-checkout";
+    struct stat fileStatus;
+    if (stat(file.c_str(), &fileStatus) != 0) 
+    {
+        cache = SparseConeCache();
+        return cache.cone;
+    }
+    int64_t mtimeNs = mtimeNanoseconds(fileStatus);
+    if (cache.file != file || cache.inode != fileStatus.st_ino || cache.size != fileStatus.st_size || cache.mtimeNs != mtimeNs) 
+    {
+        ifstream patternFile(file);
+        vector<string> patterns;
+        string line;
+        while (getline(patternFile, line)) 
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') 
+            {
+                patterns.push_back(line);
+            }
+        }
+        // A file with no patterns would hide everything; treat it as absent
+        cache.cone = patterns.empty() ? SparseCone() : SparseCone(patterns);
+        cache.file = file;
+        cache.inode = fileStatus.st_ino;
+        cache.size = fileStatus.st_size;
+        cache.mtimeNs = mtimeNs;
+    }
+    return cache.cone;
+}
+
+// Add command: Adds files to the staging area (index)
+void addFiles(const vector<string>& file_paths) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+
+    // Files are hashed and stored without holding the index; the changes are
+    // then applied to the index as it is once locked, so concurrent adds of
+    // different files all land
+    struct AddStep 
+    {
+        char kind;  // 'A' stage a file, 'D' drop deleted files below a directory, 'R' unstage a path
+        string filePath;
+        string sha;
+        string mode;
+        struct stat fileStatus;
+    };
+    vector<AddStep> steps;
+    ObjectTransaction transaction;
+    auto stageFile = [&](const string &file_path) 
+    {
+        // Stat before reading so a concurrent edit makes the entry look stale, not clean
+        struct stat fileStatus;
+        if (stat(file_path.c_str(), &fileStatus) != 0) 
+        {
+            cerr << "Error: Unable to open the specified file " << file_path << "\n";
+            return;
+        }
+        string sha1_hash = computeObjectHash(file_path, true);
+        if (!sha1_hash.empty()) 
+        {
+            string mode = (fileStatus.st_mode & S_IXUSR) ? "100755" : "100644";
+            steps.push_back(AddStep{'A', indexPathFor(file_path), sha1_hash, mode, fileStatus});
+        }
+    };
+
+    for (const string& file_path : file_paths) 
+    {
+        if (is_regular_file(file_path)) 
+        {
+            stageFile(file_path);
+        } 
+        else if (is_directory(file_path)) 
+        {
+            for (auto it = recursive_directory_iterator(file_path); it != recursive_directory_iterator(); ++it) 
+            {
+                if (it->path().filename() == ".mygit") 
+                {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                if (is_regular_file(it->path())) 
+                {
+                    stageFile(relative(it->path()).string());
+                }
+            }
+            steps.push_back(AddStep{'D', indexPathFor(file_path), "", "", {}});
+        } 
+        else 
+        {
+            steps.push_back(AddStep{'R', file_path, "", "", {}});
+        }
+    }
+
+    // Objects must be durable before the index refers to them
+    if (!transaction.commit()) 
+    {
+        return;
+    }
+
+    IndexLock lock;
+    Index index;
+    if (!lock.acquire() || !readIndex(index)) 
+    {
+        return;
+    }
+    for (const AddStep &step : steps) 
+    {
+        if (step.kind == 'A') 
+        {
+            stageEntry(index, step.filePath, step.sha, step.mode, &step.fileStatus);
+            cout << "Added " << step.filePath << " to index.\n";
+        } 
+        else if (step.kind == 'D') 
+        {
+            // Stage deletions of tracked files that are gone from this directory
+            const string &dirPath = step.filePath;
+            const SparseCone &cone = sparseCone();
+            vector<string> missing;
+            for (auto it = index.entries.lower_bound(dirPath); it != index.entries.end(); ++it) 
+            {
+                if (!dirPath.empty() && it->first.compare(0, dirPath.size() + 1, dirPath + "/") != 0) 
+                {
+                    break;
+                }
+                if (!is_regular_file(it->first) && cone.includes(it->first)) 
+                {
+                    missing.push_back(it->first);
+                }
+            }
+            for (const string &gone : missing) 
+            {
+                invalidateCacheTree(index, gone);
+                index.entries.erase(gone);
+                cout << "Removed " << gone << " from index.\n";
+            }
+        } 
+        else if (unstagePath(index, indexPathFor(step.filePath))) 
+        {
+            cout << "Removed " << indexPathFor(step.filePath) << " from index.\n";
+        } 
+        else 
+        {
+            cerr << "Error: " << step.filePath << " is not a valid file or directory.\n";
+        }
+    }
+    writeIndex(index, lock);
+}
+
+void setupGitRepo() {
+    path myGitFolder = gitDir();
+    path objectsFolder = myGitFolder / "objects";
+    path refsFolder = myGitFolder / "refs";
+    path headFilePath = myGitFolder / "HEAD";
+    path indexFilePath = myGitFolder / "index";  
+
+
+    // Check if the .mygit folder already exists
+    if (exists(myGitFolder)) 
+    {
+        cout << "Repository has already been initialized.\n";
+
+        // Check for necessary files and folders
+        bool missing = false;
+
+        if (!exists(objectsFolder)) 
+        {
+            cout << "Creating missing directory: " << objectsFolder << "\n";
+            create_directory(objectsFolder);
+            missing = true;
+        }
+
+        if (!exists(refsFolder)) 
+        {
+            cout << "Creating missing directory: " << refsFolder << "\n";
+            create_directory(refsFolder);
+            missing = true;
+        }
+
+        if (!exists(headFilePath)) 
+        {
+            cout << "Creating missing HEAD file: " << headFilePath << "\n";
+            ofstream headFileStream(headFilePath);
+            if (headFileStream.is_open()) 
+            {
+                headFileStream << "ref: refs/heads/main\n";  // Initial reference for the main branch
+                headFileStream.close();
+            } else 
+            {
+                cerr << "Error: Failed to create HEAD file.\n";
+                return;
+            }
+            missing = true;
+        }
+
+        if (!exists(indexFilePath)) 
+        {
+            cout << "Creating missing index file: " << indexFilePath << "\n";
+            ofstream indexFileStream(indexFilePath);
+            if (indexFileStream.is_open()) 
+            {
+                indexFileStream.close();
+            } else 
+            {
+                cerr << "Error: Failed to create index file.\n";
+                return;
+            }
+            missing = true;
+        }
+
+        if (!missing) 
+        {
+            cout << "All necessary files and folders are present.\n";
+        } 
+        else 
+        {
+            cout << "Missing files and folders have been created.\n";
+        }
+
+        return;
+    }
+
+// Create required directories
+    try {
+        create_directory(myGitFolder);
+        create_directory(objectsFolder);
+        create_directory(refsFolder);
+
+        ofstream headFileStream(headFilePath);
+        if (headFileStream.is_open()) 
+        {
+            headFileStream << "ref: refs/heads/main\n";  
+            headFileStream.close();
+        } 
+        else 
+        {
+            cerr << "Error: Failed to create HEAD file.\n";
+            return;
+        }
+
+        ofstream indexFileStream(indexFilePath);
+        if (indexFileStream.is_open()) 
+        {
+            indexFileStream.close();
+        } 
+        else 
+        {
+            cerr << "Error: Failed to create index file.\n";
+            return;
+        }
+
+        cout << "Initialized an empty Git repository located at " << absolute(myGitFolder) << "\n";
+    } 
+    catch (const exception &ex) 
+    {
+        cerr << "Error: " << ex.what() << "\n";
+    }
+}
+
+// Struct to represent a Commit
+struct Commit 
+{
+    string sha;
+    string tree_sha;
+    string message;
+    string parent_sha;
+    time_t timestamp;
+};
+
+Commit createCommit(const string &message, const string &tree_sha, const string &parent_sha) 
+{
+    Commit commit;
+    commit.tree_sha = tree_sha;
+    commit.message = message;
+    commit.parent_sha = parent_sha;
+    commit.timestamp = time(nullptr);
+
+    // Get the username of the logged-in user
+    const char* username = getlogin();
+    string authorName = username ? username : "Unknown User";
+    string authorEmail = authorName + "@students.iit.ac.in"; 
+
+    // Create a time string for the commit timestamp
+    std::ostringstream timeStream;
+    std::tm localTime;
+    localtime_r(&commit.timestamp, &localTime); 
+
+ 
+    timeStream << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S");
+
+
+    ostringstream commit_content;
+    commit_content << "tree " << tree_sha << "\n";
+    if (!parent_sha.empty()) 
+    {
+        commit_content << "parent " << parent_sha << "\n";
+    }
+    
+    commit_content << "Committer " << authorName << " <" << authorEmail << ">\n" 
+                   << "Timestamp "<<timeStream.str() << " +0530\n"; 
+    commit_content << "Message "<< message << "\n"; 
+
+    commit.sha = storeObject(commit_content.str());
+
+    return commit;
+}
+
+
+
+// Return the tree SHA recorded in a commit object, or "" if it can't be read
+string commitTreeSha(const string &commitSha) 
+{
+    thread_local string data;
+    CommitView view;
+    if (!readObject(commitSha, data) || !parseCommit(data, view)) 
+    {
+        return "";
+    }
+    return string(view.tree);
+}
+
+// One path that differs between two trees. Status is 'A', 'D' or 'M'; the side
+// that doesn't exist has mode 0 and an all-zero SHA.
+struct TreeChange 
+{
+    char status;
+    string path;
+    unsigned oldMode;
+    unsigned newMode;
+    string oldSha;
+    string newSha;
+};
+
+using TreeChangeCallback = function<void(const TreeChange &)>;
+
+static const string zeroSha(40, '0');
+
+// Entries of a tree in name order; legacy text trees are not guaranteed sorted
+static bool loadSortedEntries(const string &treeData, vector<TreeEntryView> &entries) 
+{
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        entries.push_back(entry);
+    }
+    auto byName = [](const TreeEntryView &a, const TreeEntryView &b) { return a.name < b.name; };
+    if (!is_sorted(entries.begin(), entries.end(), byName)) 
+    {
+        sort(entries.begin(), entries.end(), byName);
+    }
+    return !reader.failed();
+}
+
+static void diffTreeShas(const string &oldTree, const string &newTree, const string &prefix, const TreeChangeCallback &emit);
+
+// Report every entry of a subtree that exists on one side only
+static void emitWholeSide(const TreeEntryView &entry, const string &entryPath, bool added, const TreeChangeCallback &emit) 
+{
+    if (entry.isTree()) 
+    {
+        string sha = entry.sha();
+        diffTreeShas(added ? "" : sha, added ? sha : "", entryPath + "/", emit);
+        return;
+    }
+    TreeChange change{added ? 'A' : 'D', entryPath, added ? 0 : entry.mode, added ? entry.mode : 0,
+                      added ? zeroSha : entry.sha(), added ? entry.sha() : zeroSha};
+    emit(change);
+}
+
+// Merge-join two trees by name; subtrees with equal IDs are never read.
+// Either SHA may be "" for a tree that doesn't exist on that side.
+static void diffTreeShas(const string &oldTree, const string &newTree, const string &prefix, const TreeChangeCallback &emit) 
+{
+    if (oldTree == newTree) 
+    {
+        return;
+    }
+
+    string oldData, newData;
+    for (const string *sha : {&oldTree, &newTree}) 
+    {
+        if (!sha->empty() && !readObject(*sha, sha == &oldTree ? oldData : newData)) 
+        {
+            throw runtime_error("Tree object not found: " + *sha);
+        }
+    }
+    vector<TreeEntryView> oldEntries, newEntries;
+    if (!loadSortedEntries(oldData, oldEntries) || !loadSortedEntries(newData, newEntries)) 
+    {
+        throw runtime_error("Corrupt tree object under " + (prefix.empty() ? string("/") : prefix));
+    }
+
+    size_t i = 0, j = 0;
+    while (i < oldEntries.size() || j < newEntries.size()) 
+    {
+        int order;
+        if (i == oldEntries.size()) order = 1;
+        else if (j == newEntries.size()) order = -1;
+        else order = oldEntries[i].name.compare(newEntries[j].name);
+
+        if (order < 0) 
+        {
+            const TreeEntryView &entry = oldEntries[i++];
+            emitWholeSide(entry, prefix + string(entry.name), false, emit);
+            continue;
+        }
+        if (order > 0) 
+        {
+            const TreeEntryView &entry = newEntries[j++];
+            emitWholeSide(entry, prefix + string(entry.name), true, emit);
+            continue;
+        }
+
+        const TreeEntryView &before = oldEntries[i++];
+        const TreeEntryView &after = newEntries[j++];
+        if (before.mode == after.mode && memcmp(before.id, after.id, rawShaLength) == 0) 
+        {
+            continue;
+        }
+        string entryPath = prefix + string(after.name);
+        if (before.isTree() && after.isTree()) 
+        {
+            diffTreeShas(before.sha(), after.sha(), entryPath + "/", emit);
+        } 
+        else if (before.isTree() != after.isTree()) 
+        {
+            // A file replaced a directory or the other way round
+            emitWholeSide(before, entryPath, false, emit);
+            emitWholeSide(after, entryPath, true, emit);
+        } 
+        else 
+        {
+            emit(TreeChange{'M', entryPath, before.mode, after.mode, before.sha(), after.sha()});
+        }
+    }
+}
+
+// Stream the differences between two trees in path order
+void diffTrees(const string &oldTree, const string &newTree, const TreeChangeCallback &emit) 
+{
+    TraceSpan span("diff-tree");
+    span.arg("old", oldTree);
+    span.arg("new", newTree);
+    diffTreeShas(oldTree, newTree, "", emit);
+}
+
+// Refs. HEAD holds "ref: refs/heads/<branch>", or a commit SHA when detached.
+// A ref is a loose file .mygit/refs/... holding its SHA, or a line in
+// .mygit/packed-refs; a loose file overrides the packed line. packed-refs is
+// sorted by ref name, so looking a ref up is a binary search over the file:
+//
+//   # pack-refs with: sorted
+//   <sha> <refname>
+//
+// The file is read once per thread and re-read only when stat() shows it
+// was replaced, so resolving many refs costs one open() each for the loose
+// lookup and no parsing.
+static const string packedRefsHeader = "# pack-refs with: sorted";
+
+struct PackedRefs 
+{
+    path file;
+    ino_t inode = 0;
+    off_t size = -1;
+    int64_t mtimeNs = 0;
+    string data;
+};
+
+// Content of the current repository's packed-refs ("" if there is none),
+// valid until the next call
+static string_view packedRefs() 
+{
+    thread_local PackedRefs cache;
+    path file = gitDir() / "packed-refs";
+    struct stat fileStatus;
+    if (stat(file.c_str(), &fileStatus) != 0) 
+    {
+        return "";
+    }
+    int64_t mtimeNs = mtimeNanoseconds(fileStatus);
+    if (cache.file != file || cache.inode != fileStatus.st_ino || cache.size != fileStatus.st_size || cache.mtimeNs != mtimeNs) 
+    {
+        ifstream input(file, ios::binary);
+        ostringstream content;
+        content << input.rdbuf();
+        cache.data = content.str();
+        cache.file = file;
+        cache.inode = fileStatus.st_ino;
+        cache.size = fileStatus.st_size;
+        cache.mtimeNs = mtimeNs;
+    }
+    return cache.data;
+}
+
+// Offset of the first record line, after the header
+static size_t packedRefsStart(string_view data) 
+{
+    if (!data.empty() && data[0] == '#') 
+    {
+        size_t eol = data.find('\n');
+        return eol == string_view::npos ? data.size() : eol + 1;
+    }
+    return 0;
+}
+
+// Binary search of sorted packed-refs data for name
+static bool findPackedRef(string_view data, string_view name, string &sha) 
+{
+    size_t low = packedRefsStart(data);
+    size_t high = data.size();
+    while (low < high) 
+    {
+        // Back up from the midpoint to the start of its line
+        size_t mid = low + (high - low) / 2;
+        size_t start = data.rfind('\n', mid);
+        start = (start == string_view::npos || start < low) ? low : start + 1;
+        if (start >= high) 
+        {
+            start = low;
+        }
+        size_t end = data.find('\n', start);
+        if (end == string_view::npos) 
+        {
+            end = data.size();
+        }
+        string_view line = data.substr(start, end - start);
+        string_view refName = line.size() > 41 ? line.substr(41) : string_view();
+        if (refName == name) 
+        {
+            sha = string(line.substr(0, 40));
+            return true;
+        }
+        if (name < refName) 
+        {
+            high = start;
+        } 
+        else 
+        {
+            low = end + 1;
+        }
+    }
+    return false;
+}
+
+// Ref names are "refs/..." with git's restrictions on components
+bool isValidRefName(const string &name) 
+{
+    if (name.compare(0, 5, "refs/") != 0 || name.back() == '/' || name.find("..") != string::npos || name.find("//") != string::npos || name.find("/.") != string::npos) 
+    {
+        return false;
+    }
+    if (name.size() >= 5 && name.compare(name.size() - 5, 5, ".lock") == 0) 
+    {
+        return false;
+    }
+    for (char c : name) 
+    {
+        if (static_cast<unsigned char>(c) <= ' ' || c == 0x7f || strchr("~^:?*[\\", c)) 
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// SHA a ref points at; false if it doesn't exist
+bool readRef(const string &name, string &sha) 
+{
+    ifstream refFile(gitDir() / name);
+    if (refFile.is_open()) 
+    {
+        getline(refFile, sha);
+        return sha.size() == 40;
+    }
+    return findPackedRef(packedRefs(), name, sha);
+}
+
+// Point ref name at sha: the new value goes to name.lock and is renamed over
+// the loose file, so readers see the old or the new SHA, never a partial one
+bool writeRef(const string &name, const string &sha) 
+{
+    if (!isValidRefName(name)) 
+    {
+        reportError("Invalid ref name " + name + ".");
+        return false;
+    }
+    path refPath = gitDir() / name;
+    path lockPath = refPath;
+    lockPath += ".lock";
+    error_code ignored;
+    create_directories(refPath.parent_path(), ignored);
+    int fd = open(lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) 
+    {
+        reportError("Unable to lock " + name + ": " + strerror(errno));
+        return false;
+    }
+    bool ok = writeAll(fd, sha + "\n");
+    close(fd);
+    if (!ok || ::rename(lockPath.c_str(), refPath.c_str()) != 0) 
+    {
+        reportError("Could not update " + name + ": " + strerror(errno));
+        unlink(lockPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The branch HEAD is on ("refs/heads/<branch>"), or "" when detached
+string headBranch() 
+{
+    ifstream head_file(gitDir() / "HEAD");
+    string ref;
+    getline(head_file, ref);
+    if (ref.compare(0, 5, "ref: ") == 0) 
+    {
+        return ref.substr(5);
+    }
+    return "";
+}
+
+// Commit SHA that HEAD points at, or "" before the first commit
+string headCommitSha() 
+{
+    ifstream head_file(gitDir() / "HEAD");
+    string ref;
+    getline(head_file, ref);
+    if (ref.compare(0, 5, "ref: ") == 0) 
+    {
+        string sha;
+        return readRef(ref.substr(5), sha) ? sha : "";
+    }
+    return ref;
+}
+
+// Rewrite HEAD itself: "ref: <branch>" to attach it, or a SHA to detach it
+bool writeHead(const string &target) 
+{
+    path lockPath = gitDir() / "HEAD.lock";
+    {
+        ofstream headFile(lockPath, ios::trunc);
+        headFile << (target.compare(0, 5, "refs/") == 0 ? "ref: " + target : target) << "\n";
+        if (!headFile.good()) 
+        {
+            reportError("Could not write HEAD.");
+            return false;
+        }
+    }
+    rename(lockPath, gitDir() / "HEAD");
+    return true;
+}
+
+// Move the current branch to sha (or HEAD itself when detached)
+bool advanceHead(const string &sha) 
+{
+    string branch = headBranch();
+    return branch.empty() ? writeHead(sha) : writeRef(branch, sha);
+}
+
+// Every ref under prefix with its SHA, sorted by name: packed-refs merged
+// with the loose files, which win on a tie. Refs live under refs/, so a
+// shorter prefix ("" for all) is scanned from there and any other matches
+// nothing.
+void forEachRef(const string &prefix, const function<void(const string &, const string &)> &visit) 
+{
+    static const string refsRoot = "refs/";
+    size_t common = min(prefix.size(), refsRoot.size());
+    if (prefix.compare(0, common, refsRoot, 0, common) != 0) 
+    {
+        return;
+    }
+    vector<pair<string, string>> loose;
+    // Only the directory holding the prefix needs scanning
+    path refsDir = gitDir() / (prefix.size() < refsRoot.size() ? refsRoot : prefix.substr(0, prefix.rfind('/') + 1));
+    unsigned char id[rawShaLength];
+    error_code ec;
+    if (exists(refsDir)) 
+    {
+        for (auto it = recursive_directory_iterator(refsDir, ec); !ec && it != recursive_directory_iterator(); it.increment(ec)) 
+        {
+            if (!it->is_regular_file()) 
+            {
+                continue;
+            }
+            string name = it->path().lexically_relative(gitDir()).generic_string();
+            if (name.compare(0, prefix.size(), prefix) != 0 || !isValidRefName(name)) 
+            {
+                continue;
+            }
+            ifstream refFile(it->path());
+            string sha;
+            getline(refFile, sha);
+            if (hexToSha(sha, id)) 
+            {
+                loose.emplace_back(move(name), move(sha));
+            }
+        }
+    }
+    sort(loose.begin(), loose.end());
+
+    string_view packed = packedRefs();
+    size_t pos = packedRefsStart(packed);
+    size_t next = 0;
+    string name, sha;
+    while (pos < packed.size()) 
+    {
+        size_t end = packed.find('\n', pos);
+        if (end == string_view::npos) 
+        {
+            end = packed.size();
+        }
+        string_view line = packed.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.size() <= 41) 
+        {
+            continue;
+        }
+        string_view refName = line.substr(41);
+        if (refName.compare(0, prefix.size(), prefix) != 0) 
+        {
+            if (refName > prefix) 
+            {
+                break;
+            }
+            continue;
+        }
+        while (next < loose.size() && loose[next].first < refName) 
+        {
+            visit(loose[next].first, loose[next].second);
+            ++next;
+        }
+        if (next < loose.size() && loose[next].first == refName) 
+        {
+            continue;  // the loose file wins
+        }
+        name.assign(refName);
+        sha.assign(line.substr(0, 40));
+        visit(name, sha);
+    }
+    for (; next < loose.size(); ++next) 
+    {
+        visit(loose[next].first, loose[next].second);
+    }
+}
+
+// A commit named by SHA, "HEAD", a branch or a full ref name; "" if none
+string resolveRevision(const string &name) 
+{
+    if (name.size() == 40 && all_of(name.begin(), name.end(), ::isxdigit)) 
+    {
+        return name;
+    }
+    if (name == "HEAD") 
+    {
+        return headCommitSha();
+    }
+    string sha;
+    if ((isValidRefName("refs/heads/" + name) && readRef("refs/heads/" + name, sha)) || (isValidRefName(name) && readRef(name, sha))) 
+    {
+        return sha;
+    }
+    return "";
+}
+
+// for-each-ref: print "<sha> <refname>" for every ref under prefix
+void listRefs(const string &prefix) 
+{
+    TraceSpan span("for-each-ref");
+    string out;
+    size_t count = 0;
+    forEachRef(prefix, [&](const string &name, const string &sha) 
+    {
+        out += sha;
+        out += ' ';
+        out += name;
+        out += '\n';
+        ++count;
+        if (out.size() >= 64 * 1024) 
+        {
+            cout.write(out.data(), out.size());
+            out.clear();
+        }
+    });
+    cout.write(out.data(), out.size());
+    span.arg("refs", count);
+}
+
+// pack-refs: move every loose ref into packed-refs. A loose file is only
+// removed if it still holds the value that was packed.
+bool packRefs() 
+{
+    TraceSpan span("pack-refs");
+    vector<pair<string, string>> refs;
+    forEachRef("refs/", [&](const string &name, const string &sha) 
+    {
+        refs.emplace_back(name, sha);
+    });
+
+    path lockPath = gitDir() / "packed-refs.lock";
+    int fd = open(lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) 
+    {
+        reportError(string("Unable to lock packed-refs: ") + strerror(errno));
+        return false;
+    }
+    string content = packedRefsHeader + "\n";
+    for (const auto &[name, sha] : refs) 
+    {
+        content += sha + " " + name + "\n";
+    }
+    bool ok = writeAll(fd, content) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || ::rename(lockPath.c_str(), (gitDir() / "packed-refs").c_str()) != 0) 
+    {
+        reportError(string("Could not write packed-refs: ") + strerror(errno));
+        unlink(lockPath.c_str());
+        return false;
+    }
+
+    for (const auto &[name, sha] : refs) 
+    {
+        path refPath = gitDir() / name;
+        ifstream refFile(refPath);
+        string current;
+        if (refFile.is_open() && getline(refFile, current) && current == sha) 
+        {
+            refFile.close();
+            unlink(refPath.c_str());
+            // Drop directories left empty, keeping refs/<kind>/ itself
+            for (path dir = refPath.parent_path(); dir.parent_path().parent_path() != gitDir(); dir = dir.parent_path()) 
+            {
+                if (rmdir(dir.c_str()) != 0) 
+                {
+                    break;
+                }
+            }
+        }
+    }
+    span.arg("refs", refs.size());
+    cout << "Packed " << refs.size() << " refs.\n";
+    return true;
+}
+
+// update-ref <ref> <commit>: create or move a ref
+int updateRefCommand(const string &name, const string &target) 
+{
+    string sha = resolveRevision(target);
+    if (sha.empty() || commitTreeSha(sha).empty()) 
+    {
+        cerr << "Error: " << target << " is not a commit.\n";
+        return 1;
+    }
+    return writeRef(name, sha) ? 0 : 1;
+}
+
+// Accept a tree or a commit (by SHA or ref name, whose tree is used); "" if
+// neither. Objects carry no type, so anything else must start with the tree
+// magic or parse as a legacy text tree; the empty object is the empty blob
+// (the empty tree has the magic).
+string resolveTree(const string &name) 
+{
+    string sha = resolveRevision(name);
+    string data;
+    if (!readObject(sha, data) || data.empty()) 
+    {
+        return "";
+    }
+    if (data.compare(0, 5, "tree ") == 0) 
+    {
+        return data.substr(5, 40);
+    }
+    TreeReader reader(data);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        if (entry.name.empty() || (entry.mode != treeMode && entry.mode != 0100644 && entry.mode != 0100755)) 
+        {
+            return "";
+        }
+    }
+    return reader.failed() ? "" : sha;
+}
+
+void diffTreeCommand(const string &first, const string &second, const string &format) 
+{
+    string oldTree = resolveTree(first);
+    string newTree = resolveTree(second);
+    if (oldTree.empty() || newTree.empty()) 
+    {
+        cerr << "Error: " << (oldTree.empty() ? first : second) << " is not a tree or commit.\n";
+        return;
+    }
+
+    try 
+    {
+        diffTrees(oldTree, newTree, [&](const TreeChange &change) 
+        {
+            if (format == "--name-only") 
+            {
+                cout << change.path << "\n";
+            } 
+            else if (format == "--name-status") 
+            {
+                cout << change.status << "\t" << change.path << "\n";
+            } 
+            else 
+            {
+                cout << ":" << formatMode(change.oldMode) << " " << formatMode(change.newMode) << " " << change.oldSha << " "
+                     << change.newSha << " " << change.status << "\t" << change.path << "\n";
+            }
+        });
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error: " << e.what() << "\n";
+    }
+}
+
+// diff: line-level differences between two blobs, or between the files of two
+// trees or commits, as a unified diff with three lines of context. Blobs are
+// inflated straight from the object store. Lines are split with memchr() and
+// the common prefix and suffix are found with memcmp(), so a small edit to a
+// large file costs little more than reading it; only the lines in between are
+// hashed (a word at a time) and interned into integer IDs. Lines found on one
+// side only cannot match anything and are marked changed before the Myers
+// O(ND) search runs on the rest. The search uses linear space and, like GNU
+// diff, settles for a good split once it gets too expensive. Content with a
+// NUL in its first 8000 bytes is reported as binary.
+static const size_t diffContext = 3;
+static const size_t binaryCheckLength = 8000;
+
+// Whole content of blob sha, reassembling a chunked file (its chunks are
+// inflated on MYGIT_THREADS threads); false if missing
+static bool loadBlob(const string &sha, string &data) 
+{
+    uint64_t totalSize;
+    vector<ChunkRef> chunks;
+    if (!storedAsChunkList(objectFilePath(sha))) 
+    {
+        return readObject(sha, data);
+    }
+    if (!readChunkList(sha, chunks, &totalSize)) 
+    {
+        return false;
+    }
+    vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t k = 0; k < chunks.size(); ++k) 
+    {
+        offsets[k + 1] = offsets[k] + chunks[k].size;
+    }
+    if (offsets.back() != totalSize) 
+    {
+        return false;
+    }
+    data.resize(totalSize);
+
+    atomic<size_t> nextChunk{0};
+    atomic<bool> failed{false};
+    path repositoryDir = gitDir();
+    auto inflater = [&]() 
+    {
+        currentGitDir = repositoryDir;
+        string chunkData;
+        for (size_t k = nextChunk++; k < chunks.size() && !failed; k = nextChunk++) 
+        {
+            bool ok = false;
+            try 
+            {
+                ok = readObject(shaToHex(chunks[k].id), chunkData) && chunkData.size() == chunks[k].size;
+            } 
+            catch (const exception &) 
+            {
+            }
+            if (!ok) 
+            {
+                failed = true;
+                break;
+            }
+            memcpy(&data[offsets[k]], chunkData.data(), chunkData.size());
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < min<size_t>(workerCount(), chunks.size()); ++t) 
+    {
+        workers.emplace_back(inflater);
+    }
+    inflater();
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+    return !failed;
+}
+
+// Lines of one side of a diff: line i is text[start[i], start[i + 1]), its
+// newline included
+struct DiffLines 
+{
+    string_view text;
+    vector<size_t> start;
+
+    size_t count() const { return start.size() - 1; }
+    string_view line(size_t i) const { return text.substr(start[i], start[i + 1] - start[i]); }
+};
+
+static void splitLines(string_view text, DiffLines &lines) 
+{
+    lines.text = text;
+    lines.start.clear();
+    lines.start.reserve(text.size() / 32 + 2);
+    lines.start.push_back(0);
+    const char *base = text.data();
+    const char *end = base + text.size();
+    for (const char *p = base; p < end;) 
+    {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+        p = newline ? newline + 1 : end;
+        lines.start.push_back(size_t(p - base));
+    }
+}
+
+static uint64_t hashLine(string_view line) 
+{
+    const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    uint64_t hash = line.size() * multiplier;
+    const char *p = line.data();
+    size_t left = line.size();
+    for (; left >= 8; p += 8, left -= 8) 
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    if (left > 0) 
+    {
+        uint64_t word = 0;
+        memcpy(&word, p, left);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Gives equal lines equal IDs (from 1) through an open-addressed table. A
+// slot holds the line's ID and the high half of its hash, so probing touches
+// line text only when the hashes agree.
+class LineInterner 
+{
+public:
+    explicit LineInterner(size_t lineCount) 
+    {
+        size_t size = 16;
+        while (size < lineCount * 2) 
+        {
+            size <<= 1;
+        }
+        slots.assign(size, 0);
+        lines.reserve(lineCount);
+    }
+
+    // Append the IDs of lines [from, to). Hashes are computed a batch ahead
+    // and their slots prefetched, hiding the cache miss of each probe.
+    void internLines(const DiffLines &source, size_t from, size_t to, vector<uint32_t> &ids) 
+    {
+        const size_t batch = 16;
+        uint64_t hashes[batch];
+        size_t mask = slots.size() - 1;
+        for (size_t base = from; base < to; base += batch) 
+        {
+            size_t count = min(batch, to - base);
+            for (size_t k = 0; k < count; ++k) 
+            {
+                hashes[k] = hashLine(source.line(base + k));
+                __builtin_prefetch(&slots[size_t(hashes[k]) & mask]);
+            }
+            for (size_t k = 0; k < count; ++k) 
+            {
+                ids.push_back(intern(source.line(base + k), hashes[k]));
+            }
+        }
+    }
+
+    size_t size() const { return lines.size(); }
+
+private:
+    uint32_t intern(string_view line, uint64_t hash) 
+    {
+        uint64_t tag = hash & 0xffffffff00000000ull;
+        size_t mask = slots.size() - 1;
+        for (size_t i = size_t(hash) & mask;; i = (i + 1) & mask) 
+        {
+            uint64_t slot = slots[i];
+            if (slot == 0) 
+            {
+                lines.push_back(line);
+                slots[i] = tag | lines.size();
+                return uint32_t(lines.size());
+            }
+            if ((slot & 0xffffffff00000000ull) == tag && lines[uint32_t(slot) - 1] == line) 
+            {
+                return uint32_t(slot);
+            }
+        }
+    }
+
+    vector<uint64_t> slots;
+    vector<string_view> lines;
+};
+
+// Myers' middle-snake search over two ID sequences, after GNU diff's diag()
+class MyersSearch 
+{
+public:
+    MyersSearch(const vector<uint32_t> &x, const vector<uint32_t> &y) 
+        : a(x.data()), 
+          b(y.data()), 
+          forward(x.size() + y.size() + 3), 
+          backward(x.size() + y.size() + 3), 
+          offset(ptrdiff_t(y.size()) + 1)
+    {
+        // Roughly the square root of the input size, at least 4096 steps
+        for (size_t diagonals = x.size() + y.size() + 3; diagonals != 0; diagonals >>= 2) 
+        {
+            tooExpensive <<= 1;
+        }
+        tooExpensive = max<ptrdiff_t>(tooExpensive, 4096);
+    }
+
+    // A point (x, y) that a short edit path from (xoff, yoff) to (xlim, ylim)
+    // passes through, splitting the problem in two
+    pair<ptrdiff_t, ptrdiff_t> split(ptrdiff_t xoff, ptrdiff_t xlim, ptrdiff_t yoff, ptrdiff_t ylim) 
+    {
+        // Furthest x reached on each diagonal d = x - y
+        ptrdiff_t *fd = forward.data() + offset;
+        ptrdiff_t *bd = backward.data() + offset;
+        ptrdiff_t dmin = xoff - ylim, dmax = xlim - yoff;
+        ptrdiff_t fmid = xoff - yoff, bmid = xlim - ylim;
+        ptrdiff_t fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+        bool odd = (fmid - bmid) & 1;
+        fd[fmid] = xoff;
+        bd[bmid] = xlim;
+        for (ptrdiff_t cost = 1;; ++cost) 
+        {
+            // One more edit forwards
+            if (fmin > dmin) fd[--fmin - 1] = -1;
+            else ++fmin;
+            if (fmax < dmax) fd[++fmax + 1] = -1;
+            else --fmax;
+            for (ptrdiff_t d = fmax; d >= fmin; d -= 2) 
+            {
+                ptrdiff_t low = fd[d - 1], high = fd[d + 1];
+                ptrdiff_t x = low < high ? high : low + 1;
+                ptrdiff_t y = x - d;
+                while (x < xlim && y < ylim && a[x] == b[y]) 
+                {
+                    ++x;
+                    ++y;
+                }
+                fd[d] = x;
+                if (odd && bmin <= d && d <= bmax && bd[d] <= x) 
+                {
+                    return {x, y};
+                }
+            }
+
+            // And backwards
+            if (bmin > dmin) bd[--bmin - 1] = PTRDIFF_MAX;
+            else ++bmin;
+            if (bmax < dmax) bd[++bmax + 1] = PTRDIFF_MAX;
+            else --bmax;
+            for (ptrdiff_t d = bmax; d >= bmin; d -= 2) 
+            {
+                ptrdiff_t low = bd[d - 1], high = bd[d + 1];
+                ptrdiff_t x = low < high ? low : high - 1;
+                ptrdiff_t y = x - d;
+                while (xoff < x && yoff < y && a[x - 1] == b[y - 1]) 
+                {
+                    --x;
+                    --y;
+                }
+                bd[d] = x;
+                if (!odd && fmin <= d && d <= fmax && x <= fd[d]) 
+                {
+                    return {x, y};
+                }
+            }
+
+            if (cost < tooExpensive) 
+            {
+                continue;
+            }
+            // Too expensive: split where one of the searches got furthest
+            ptrdiff_t forwardBest = -1, forwardX = xoff;
+            for (ptrdiff_t d = fmax; d >= fmin; d -= 2) 
+            {
+                ptrdiff_t x = min(fd[d], xlim), y = x - d;
+                if (ylim < y) 
+                {
+                    x = ylim + d;
+                    y = ylim;
+                }
+                if (forwardBest < x + y) 
+                {
+                    forwardBest = x + y;
+                    forwardX = x;
+                }
+            }
+            ptrdiff_t backwardBest = PTRDIFF_MAX, backwardX = xlim;
+            for (ptrdiff_t d = bmax; d >= bmin; d -= 2) 
+            {
+                ptrdiff_t x = max(xoff, bd[d]), y = x - d;
+                if (y < yoff) 
+                {
+                    x = yoff + d;
+                    y = yoff;
+                }
+                if (x + y < backwardBest) 
+                {
+                    backwardBest = x + y;
+                    backwardX = x;
+                }
+            }
+            if ((xlim + ylim) - backwardBest < forwardBest - (xoff + yoff)) 
+            {
+                return {forwardX, forwardBest - forwardX};
+            }
+            return {backwardX, backwardBest - backwardX};
+        }
+    }
+
+private:
+    const uint32_t *a;
+    const uint32_t *b;
+    vector<ptrdiff_t> forward;
+    vector<ptrdiff_t> backward;
+    ptrdiff_t offset;
+    ptrdiff_t tooExpensive = 1;
+};
+
+// Mark the entries of a and b outside a common subsequence
+static void myersDiff(const vector<uint32_t> &a, const vector<uint32_t> &b, vector<char> &aChanged, vector<char> &bChanged) 
+{
+    struct Range 
+    {
+        ptrdiff_t xoff, xlim, yoff, ylim;
+    };
+    MyersSearch search(a, b);
+    vector<Range> pending{{0, ptrdiff_t(a.size()), 0, ptrdiff_t(b.size())}};
+    while (!pending.empty()) 
+    {
+        Range range = pending.back();
+        pending.pop_back();
+        auto &[xoff, xlim, yoff, ylim] = range;
+        while (xoff < xlim && yoff < ylim && a[xoff] == b[yoff]) 
+        {
+            ++xoff;
+            ++yoff;
+        }
+        while (xoff < xlim && yoff < ylim && a[xlim - 1] == b[ylim - 1]) 
+        {
+            --xlim;
+            --ylim;
+        }
+        if (xoff == xlim || yoff == ylim) 
+        {
+            fill(aChanged.begin() + xoff, aChanged.begin() + xlim, 1);
+            fill(bChanged.begin() + yoff, bChanged.begin() + ylim, 1);
+            continue;
+        }
+        auto [xmid, ymid] = search.split(xoff, xlim, yoff, ylim);
+        pending.push_back({xmid, xlim, ymid, ylim});
+        pending.push_back({xoff, xmid, yoff, ymid});
+    }
+}
+
+// Length of the common prefix (or, backwards, suffix) of a and b
+static size_t commonBytes(string_view a, string_view b, bool backwards) 
+{
+    size_t limit = min(a.size(), b.size());
+    const char *x = backwards ? a.data() + a.size() - limit : a.data();
+    const char *y = backwards ? b.data() + b.size() - limit : b.data();
+    const size_t block = 4096;
+    size_t same = 0;
+    while (same < limit) 
+    {
+        size_t length = min(block, limit - same);
+        size_t at = backwards ? limit - same - length : same;
+        if (memcmp(x + at, y + at, length) != 0) 
+        {
+            if (backwards) 
+            {
+                for (size_t i = at + length; x[i - 1] == y[i - 1]; --i) 
+                {
+                    ++same;
+                }
+            } 
+            else 
+            {
+                for (size_t i = at; x[i] == y[i]; ++i) 
+                {
+                    ++same;
+                }
+            }
+            break;
+        }
+        same += length;
+    }
+    return same;
+}
+
+// Mark the lines of each side that are not in a common subsequence
+static void diffLines(const DiffLines &oldLines, const DiffLines &newLines, vector<char> &oldChanged, vector<char> &newChanged) 
+{
+    size_t oldCount = oldLines.count(), newCount = newLines.count();
+    oldChanged.assign(oldCount, 0);
+    newChanged.assign(newCount, 0);
+
+    // Whole lines inside the common prefix and suffix agree
+    size_t same = commonBytes(oldLines.text, newLines.text, false);
+    size_t prefix = 0;
+    while (prefix < oldCount && prefix < newCount && oldLines.start[prefix + 1] == newLines.start[prefix + 1] && oldLines.start[prefix + 1] <= same) 
+    {
+        ++prefix;
+    }
+    size_t sameEnd = commonBytes(oldLines.text, newLines.text, true);
+    size_t suffix = 0;
+    while (oldCount - suffix > prefix && newCount - suffix > prefix) 
+    {
+        size_t oldTail = oldLines.text.size() - oldLines.start[oldCount - suffix - 1];
+        size_t newTail = newLines.text.size() - newLines.start[newCount - suffix - 1];
+        if (oldTail != newTail || oldTail > sameEnd) 
+        {
+            break;
+        }
+        ++suffix;
+    }
+    size_t oldEnd = oldCount - suffix, newEnd = newCount - suffix;
+
+    LineInterner interner(oldEnd - prefix + newEnd - prefix);
+    vector<uint32_t> oldIds, newIds;
+    oldIds.reserve(oldEnd - prefix);
+    newIds.reserve(newEnd - prefix);
+    interner.internLines(oldLines, prefix, oldEnd, oldIds);
+    interner.internLines(newLines, prefix, newEnd, newIds);
+
+    // Lines on one side only are changes; the search runs on the rest
+    vector<char> inOld(interner.size() + 1, 0), inNew(interner.size() + 1, 0);
+    for (uint32_t id : oldIds) 
+    {
+        inOld[id] = 1;
+    }
+    for (uint32_t id : newIds) 
+    {
+        inNew[id] = 1;
+    }
+    vector<uint32_t> oldKept, newKept;
+    vector<size_t> oldLine, newLine;
+    for (size_t i = 0; i < oldIds.size(); ++i) 
+    {
+        if (inNew[oldIds[i]]) 
+        {
+            oldKept.push_back(oldIds[i]);
+            oldLine.push_back(prefix + i);
+        } 
+        else 
+        {
+            oldChanged[prefix + i] = 1;
+        }
+    }
+    for (size_t i = 0; i < newIds.size(); ++i) 
+    {
+        if (inOld[newIds[i]]) 
+        {
+            newKept.push_back(newIds[i]);
+            newLine.push_back(prefix + i);
+        } 
+        else 
+        {
+            newChanged[prefix + i] = 1;
+        }
+    }
+    vector<char> oldKeptChanged(oldKept.size(), 0), newKeptChanged(newKept.size(), 0);
+    myersDiff(oldKept, newKept, oldKeptChanged, newKeptChanged);
+    for (size_t i = 0; i < oldKept.size(); ++i) 
+    {
+        oldChanged[oldLine[i]] = oldKeptChanged[i];
+    }
+    for (size_t i = 0; i < newKept.size(); ++i) 
+    {
+        newChanged[newLine[i]] = newKeptChanged[i];
+    }
+}
+
+static void appendDiffLine(string &out, char marker, string_view line) 
+{
+    out += marker;
+    out.append(line.data(), line.size());
+    if (line.empty() || line.back() != '\n') 
+    {
+        out += "\n\\ No newline at end of file\n";
+    }
+}
+
+// "start,count" of a hunk side; start is 1-based, or the line before an
+// empty side
+static string hunkRange(size_t start, size_t count) 
+{
+    if (count == 1) 
+    {
+        return to_string(start + 1);
+    }
+    return to_string(count == 0 ? start : start + 1) + "," + to_string(count);
+}
+
+// Append the hunks of a line diff to out
+static void writeHunks(const DiffLines &oldLines, const DiffLines &newLines, const vector<char> &oldChanged, const vector<char> &newChanged, string &out) 
+{
+    struct Block 
+    {
+        size_t oldStart, oldEnd, newStart, newEnd;
+    };
+    vector<Block> blocks;
+    size_t oldCount = oldLines.count(), newCount = newLines.count();
+    for (size_t i = 0, j = 0; i < oldCount || j < newCount;) 
+    {
+        if (i < oldCount && j < newCount && !oldChanged[i] && !newChanged[j]) 
+        {
+            ++i;
+            ++j;
+            continue;
+        }
+        Block block{i, i, j, j};
+        while (i < oldCount && oldChanged[i]) 
+        {
+            ++i;
+        }
+        while (j < newCount && newChanged[j]) 
+        {
+            ++j;
+        }
+        if (i == block.oldStart && j == block.newStart) 
+        {
+            break;  // the marks disagree; cannot happen
+        }
+        block.oldEnd = i;
+        block.newEnd = j;
+        blocks.push_back(block);
+    }
+
+    for (size_t first = 0; first < blocks.size();) 
+    {
+        size_t last = first;
+        while (last + 1 < blocks.size() && blocks[last + 1].oldStart - blocks[last].oldEnd <= 2 * diffContext) 
+        {
+            ++last;
+        }
+        size_t before = min(diffContext, blocks[first].oldStart);
+        size_t after = min({diffContext, oldCount - blocks[last].oldEnd, newCount - blocks[last].newEnd});
+        size_t oldStart = blocks[first].oldStart - before, newStart = blocks[first].newStart - before;
+        size_t oldEnd = blocks[last].oldEnd + after, newEnd = blocks[last].newEnd + after;
+        out += "@@ -" + hunkRange(oldStart, oldEnd - oldStart) + " +" + hunkRange(newStart, newEnd - newStart) + " @@\n";
+
+        size_t i = oldStart;
+        for (size_t k = first; k <= last; ++k) 
+        {
+            for (; i < blocks[k].oldStart; ++i) 
+            {
+                appendDiffLine(out, ' ', oldLines.line(i));
+            }
+            for (; i < blocks[k].oldEnd; ++i) 
+            {
+                appendDiffLine(out, '-', oldLines.line(i));
+            }
+            for (size_t j = blocks[k].newStart; j < blocks[k].newEnd; ++j) 
+            {
+                appendDiffLine(out, '+', newLines.line(j));
+            }
+        }
+        for (; i < oldEnd; ++i) 
+        {
+            appendDiffLine(out, ' ', oldLines.line(i));
+        }
+        if (out.size() >= 64 * 1024) 
+        {
+            cout.write(out.data(), out.size());
+            out.clear();
+        }
+        first = last + 1;
+    }
+}
+
+static bool isBinary(string_view data) 
+{
+    return memchr(data.data(), '\0', min(data.size(), binaryCheckLength)) != nullptr;
+}
+
+// Append the diff of one file to out. A side whose path is "" does not exist;
+// oldMode and newMode are 0 when not known (two blobs).
+static void diffFile(const TreeChange &change, const string &oldPath, const string &newPath, string &out) 
+{
+    TraceSpan span("diff.file");
+    span.arg("path", change.path);
+    string oldName = oldPath.empty() ? "/dev/null" : "a/" + oldPath;
+    string newName = newPath.empty() ? "/dev/null" : "b/" + newPath;
+    out += "diff --mygit a/" + (oldPath.empty() ? newPath : oldPath) + " b/" + (newPath.empty() ? oldPath : newPath) + "\n";
+    if (oldPath.empty()) 
+    {
+        out += "new file mode " + formatMode(change.newMode) + "\n";
+    } 
+    else if (newPath.empty()) 
+    {
+        out += "deleted file mode " + formatMode(change.oldMode) + "\n";
+    } 
+    else if (change.oldMode != change.newMode) 
+    {
+        out += "old mode " + formatMode(change.oldMode) + "\nnew mode " + formatMode(change.newMode) + "\n";
+    }
+    if (change.oldSha == change.newSha) 
+    {
+        return;
+    }
+    out += "index " + change.oldSha.substr(0, 7) + ".." + change.newSha.substr(0, 7) + "\n";
+
+    string oldData, newData;
+    if ((!oldPath.empty() && !loadBlob(change.oldSha, oldData)) || (!newPath.empty() && !loadBlob(change.newSha, newData))) 
+    {
+        throw runtime_error("Unable to read the blobs of " + change.path);
+    }
+    if (isBinary(oldData) || isBinary(newData)) 
+    {
+        out += "Binary files " + oldName + " and " + newName + " differ\n";
+        return;
+    }
+    out += "--- " + oldName + "\n+++ " + newName + "\n";
+    DiffLines oldLines, newLines;
+    splitLines(oldData, oldLines);
+    splitLines(newData, newLines);
+    vector<char> oldChanged, newChanged;
+    diffLines(oldLines, newLines, oldChanged, newChanged);
+    span.arg("lines", oldLines.count() + newLines.count());
+    span.arg("changed", size_t(count(oldChanged.begin(), oldChanged.end(), 1) + count(newChanged.begin(), newChanged.end(), 1)));
+    writeHunks(oldLines, newLines, oldChanged, newChanged, out);
+}
+
+// diff <blob|commit> <blob|commit>: trees and commits are compared file by
+// file, anything else as two blobs
+int diffCommand(const string &first, const string &second) 
+{
+    TraceSpan span("diff");
+    string oldTree = resolveTree(first);
+    string newTree = resolveTree(second);
+    string out;
+    try 
+    {
+        if (!oldTree.empty() && !newTree.empty()) 
+        {
+            diffTrees(oldTree, newTree, [&](const TreeChange &change) 
+            {
+                diffFile(change, change.status == 'A' ? "" : change.path, change.status == 'D' ? "" : change.path, out);
+            });
+        } 
+        else 
+        {
+            string oldSha = resolveRevision(first), newSha = resolveRevision(second);
+            for (const string *sha : {&oldSha, &newSha}) 
+            {
+                if (sha->empty() || !exists(objectFilePath(*sha))) 
+                {
+                    cerr << "Error: " << (sha == &oldSha ? first : second) << " is not a blob, tree or commit.\n";
+                    return 1;
+                }
+            }
+            if (oldSha != newSha) 
+            {
+                diffFile(TreeChange{'M', first, 0, 0, oldSha, newSha}, first, second, out);
+            }
+        }
+    } 
+    catch (const exception &e) 
+    {
+        cout.write(out.data(), out.size());
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    cout.write(out.data(), out.size());
+    return 0;
+}
+
+// Compare the index range [from, to) below dirPath with a tree ("" when the
+// tree has no such directory). Directories whose cache-tree SHA equals the
+// tree's are skipped without reading anything.
+static void diffTreeAgainstIndex(const Index &index, const IndexRange &sorted, size_t from, size_t to, const string &dirPath,
+                                 const string &treeSha, const TreeChangeCallback &emit) 
+{
+    auto cached = index.cacheTree.find(dirPath);
+    if (!treeSha.empty() && cached != index.cacheTree.end() && cached->second.sha == treeSha && cached->second.entryCount == long(to - from)) 
+    {
+        return;
+    }
+
+    // Direct children on the index side, in name order like tree entries
+    struct IndexChild 
+    {
+        string name;
+        size_t from;
+        size_t to;
+        bool isDir;
+    };
+    string prefix = dirPath.empty() ? "" : dirPath + "/";
+    vector<IndexChild> children;
+    for (size_t i = from; i < to;) 
+    {
+        string rest = sorted[i]->first.substr(prefix.size());
+        size_t slash = rest.find('/');
+        if (slash == string::npos) 
+        {
+            children.push_back(IndexChild{rest, i, i + 1, false});
+            ++i;
+            continue;
+        }
+        string name = rest.substr(0, slash);
+        size_t end = endOfPrefix(sorted, i, to, prefix + name + "/");
+        children.push_back(IndexChild{name, i, end, true});
+        i = end;
+    }
+    sort(children.begin(), children.end(), [](const IndexChild &a, const IndexChild &b) { return a.name < b.name; });
+
+    string treeData;
+    vector<TreeEntryView> treeEntries;
+    if (!treeSha.empty() && (!readObject(treeSha, treeData) || !loadSortedEntries(treeData, treeEntries))) 
+    {
+        throw runtime_error("Tree object not found: " + treeSha);
+    }
+
+    auto emitIndexSide = [&](const IndexChild &child) 
+    {
+        for (size_t k = child.from; k < child.to; ++k) 
+        {
+            const IndexEntry &entry = sorted[k]->second;
+            if (isSparseDirectory(entry)) 
+            {
+                diffTreeShas("", entry.sha, sorted[k]->first + "/", emit);
+                continue;
+            }
+            emit(TreeChange{'A', sorted[k]->first, 0, unsigned(stoul(entry.mode, nullptr, 8)), zeroSha, entry.sha});
+        }
+    };
+
+    size_t i = 0, j = 0;
+    while (i < treeEntries.size() || j < children.size()) 
+    {
+        int order;
+        if (i == treeEntries.size()) order = 1;
+        else if (j == children.size()) order = -1;
+        else order = treeEntries[i].name.compare(children[j].name);
+
+        if (order < 0) 
+        {
+            const TreeEntryView &entry = treeEntries[i++];
+            emitWholeSide(entry, prefix + string(entry.name), false, emit);
+            continue;
+        }
+        if (order > 0) 
+        {
+            emitIndexSide(children[j++]);
+            continue;
+        }
+
+        const TreeEntryView &entry = treeEntries[i++];
+        const IndexChild &child = children[j++];
+        string childPath = prefix + child.name;
+        if (entry.isTree() && child.isDir) 
+        {
+            diffTreeAgainstIndex(index, sorted, child.from, child.to, childPath, entry.sha(), emit);
+        } 
+        else if (!child.isDir && isSparseDirectory(sorted[child.from]->second)) 
+        {
+            diffTreeShas(entry.isTree() ? entry.sha() : "", sorted[child.from]->second.sha, childPath + "/", emit);
+            if (!entry.isTree()) 
+            {
+                emitWholeSide(entry, childPath, false, emit);
+            }
+        } 
+        else if (entry.isTree() != child.isDir) 
+        {
+            emitWholeSide(entry, childPath, false, emit);
+            emitIndexSide(child);
+        } 
+        else 
+        {
+            const IndexEntry &staged = sorted[child.from]->second;
+            unsigned stagedMode = unsigned(stoul(staged.mode, nullptr, 8));
+            string treeEntrySha = entry.sha();
+            if (stagedMode != entry.mode || staged.sha != treeEntrySha) 
+            {
+                emit(TreeChange{'M', childPath, entry.mode, stagedMode, treeEntrySha, staged.sha});
+            }
+        }
+    }
+}
+
+// Index entries whose worktree file differs: 'M' modified, 'D' deleted.
+// Files whose stat data matches the index are not read; files that had to be
+// hashed but turned out clean get fresh stat data in refreshed.
+static void checkWorktreeShard(const Index &index, const IndexRange &sorted, const SparseCone &cone, size_t from, size_t to,
+                               vector<pair<size_t, char>> &changes, vector<pair<size_t, struct stat>> &refreshed) 
+{
+    for (size_t i = from; i < to; ++i) 
+    {
+        const string &filePath = sorted[i]->first;
+        const IndexEntry &entry = sorted[i]->second;
+        if (isSparseDirectory(entry)) 
+        {
+            continue;
+        }
+        struct stat fileStatus;
+        if (stat(filePath.c_str(), &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)) 
+        {
+            // Files outside the sparse-checkout cone are expected to be absent
+            if (cone.includes(filePath)) 
+            {
+                changes.emplace_back(i, 'D');
+            }
+            continue;
+        }
+        string mode = (fileStatus.st_mode & S_IXUSR) ? "100755" : "100644";
+        if (mode != entry.mode) 
+        {
+            changes.emplace_back(i, 'M');
+            continue;
+        }
+
+        // An entry stamped no earlier than the index itself may have been edited
+        // again within the same timestamp tick, so it must be hashed
+        bool racy = entry.mtimeNs >= index.fileMtimeNs;
+        if (entry.size == fileStatus.st_size && entry.mtimeNs == mtimeNanoseconds(fileStatus) && !racy) 
+        {
+            continue;
+        }
+        if (entry.size >= 0 && entry.size != fileStatus.st_size) 
+        {
+            changes.emplace_back(i, 'M');
+            continue;
+        }
+        if (computeObjectHash(filePath) != entry.sha) 
+        {
+            changes.emplace_back(i, 'M');
+        } 
+        else 
+        {
+            refreshed.emplace_back(i, fileStatus);
+        }
+    }
+}
+
+// True if any index entry lives below dirPath
+static bool hasTrackedBelow(const Index &index, const string &dirPath) 
+{
+    string prefix = dirPath + "/";
+    auto it = index.entries.lower_bound(prefix);
+    return it != index.entries.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Collect untracked paths below dirPath; directories with nothing tracked are
+// reported once as "dir/" instead of being walked
+static void scanUntracked(const Index &index, const string &entryPath, vector<string> &untracked) 
+{
+    error_code error;
+    if (is_directory(entryPath, error)) 
+    {
+        // A sparse directory entry: nothing below it is checked out
+        if (index.entries.count(entryPath)) 
+        {
+            return;
+        }
+        if (!hasTrackedBelow(index, entryPath)) 
+        {
+            // Like git, directories holding no files at all are not reported
+            for (auto it = recursive_directory_iterator(entryPath, error); it != recursive_directory_iterator(); it.increment(error)) 
+            {
+                if (it->is_regular_file(error)) 
+                {
+                    untracked.push_back(entryPath + "/");
+                    break;
+                }
+            }
+            return;
+        }
+        for (const auto &child : directory_iterator(entryPath, error)) 
+        {
+            scanUntracked(index, entryPath + "/" + child.path().filename().string(), untracked);
+        }
+    } 
+    else if (!index.entries.count(entryPath)) 
+    {
+        untracked.push_back(entryPath);
+    }
+}
+
+void showStatus(bool porcelain) 
+{
+    TraceSpan span("status");
+    Index index;
+    if (!readIndex(index)) 
+    {
+        return;
+    }
+    IndexRange sorted;
+    sorted.reserve(index.entries.size());
+    for (auto it = index.entries.begin(); it != index.entries.end(); ++it) 
+    {
+        sorted.push_back(it);
+    }
+
+    // HEAD against the index
+    vector<TreeChange> staged;
+    try 
+    {
+        TraceSpan stagedSpan("status.staged");
+        string headSha = headCommitSha();
+        string headTree = headSha.empty() ? "" : commitTreeSha(headSha);
+        diffTreeAgainstIndex(index, sorted, 0, sorted.size(), "", headTree, [&](const TreeChange &change) { staged.push_back(change); });
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error: " << e.what() << "\n";
+        return;
+    }
+
+    unsigned threads = workerCount();
+
+    // The index against the worktree, sharded into contiguous ranges
+    vector<vector<pair<size_t, char>>> shardChanges(threads);
+    vector<vector<pair<size_t, struct stat>>> shardRefreshed(threads);
+    {
+        TraceSpan worktreeSpan("status.worktree");
+        // Read here: workers run without the command's repository
+        const SparseCone &cone = sparseCone();
+        vector<thread> workers;
+        size_t shardSize = (sorted.size() + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; ++t) 
+        {
+            size_t from = min(sorted.size(), t * shardSize);
+            size_t to = min(sorted.size(), from + shardSize);
+            workers.emplace_back(checkWorktreeShard, cref(index), cref(sorted), cref(cone), from, to, ref(shardChanges[t]), ref(shardRefreshed[t]));
+        }
+        for (thread &worker : workers) 
+        {
+            worker.join();
+        }
+    }
+
+    // Untracked files, with top-level entries dealt round-robin to the workers
+    vector<string> untracked;
+    {
+        TraceSpan untrackedSpan("status.untracked");
+        vector<string> roots;
+        for (const auto &entry : directory_iterator(".")) 
+        {
+            string entryName = entry.path().filename().string();
+            if (entryName != ".mygit") 
+            {
+                roots.push_back(entryName);
+            }
+        }
+        vector<vector<string>> shardUntracked(threads);
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; ++t) 
+        {
+            workers.emplace_back([&, t] 
+            {
+                for (size_t r = t; r < roots.size(); r += threads) 
+                {
+                    scanUntracked(index, roots[r], shardUntracked[t]);
+                }
+            });
+        }
+        for (thread &worker : workers) 
+        {
+            worker.join();
+        }
+        for (vector<string> &shard : shardUntracked) 
+        {
+            untracked.insert(untracked.end(), shard.begin(), shard.end());
+        }
+        sort(untracked.begin(), untracked.end());
+    }
+
+    vector<pair<size_t, char>> unstaged;
+    vector<string> refreshedPaths;
+    for (unsigned t = 0; t < threads; ++t) 
+    {
+        unstaged.insert(unstaged.end(), shardChanges[t].begin(), shardChanges[t].end());
+        for (const auto &[position, fileStatus] : shardRefreshed[t]) 
+        {
+            recordStat(index.entries[sorted[position]->first], fileStatus);
+            refreshedPaths.push_back(sorted[position]->first);
+        }
+    }
+
+    if (porcelain) 
+    {
+        // "XY path": X is the index against HEAD, Y the worktree against the index
+        map<string, string> lines;
+        for (const TreeChange &change : staged) 
+        {
+            lines[change.path] = string(1, change.status) + " ";
+        }
+        for (const auto &[position, status] : unstaged) 
+        {
+            string &code = lines.emplace(sorted[position]->first, "  ").first->second;
+            code[1] = status;
+        }
+        for (const auto &[filePath, code] : lines) 
+        {
+            cout << code << " " << filePath << "\n";
+        }
+        for (const string &filePath : untracked) 
+        {
+            cout << "?? " << filePath << "\n";
+        }
+    } 
+    else 
+    {
+        auto label = [](char status) { return status == 'A' ? "new file:   " : status == 'D' ? "deleted:    " : "modified:   "; };
+        if (!staged.empty()) 
+        {
+            cout << "Changes to be committed:\n";
+            for (const TreeChange &change : staged) 
+            {
+                cout << "\t" << label(change.status) << change.path << "\n";
+            }
+            cout << "\n";
+        }
+        if (!unstaged.empty()) 
+        {
+            cout << "Changes not staged for commit:\n";
+            for (const auto &[position, status] : unstaged) 
+            {
+                cout << "\t" << label(status) << sorted[position]->first << "\n";
+            }
+            cout << "\n";
+        }
+        if (!untracked.empty()) 
+        {
+            cout << "Untracked files:\n";
+            for (const string &filePath : untracked) 
+            {
+                cout << "\t" << filePath << "\n";
+            }
+            cout << "\n";
+        }
+        if (staged.empty() && unstaged.empty() && untracked.empty()) 
+        {
+            cout << "Nothing to commit, working tree clean.\n";
+        }
+    }
+
+    // Save the stat data of files that had to be hashed so the next run skips
+    // them. This is only a cache: it is skipped while another command holds
+    // the index, and applied to the index as it is now, for entries that still
+    // hold what was hashed.
+    IndexLock lock;
+    Index current;
+    if (!refreshedPaths.empty() && lock.acquire(false) && readIndex(current)) 
+    {
+        for (const string &filePath : refreshedPaths) 
+        {
+            const IndexEntry &hashed = index.entries[filePath];
+            auto it = current.entries.find(filePath);
+            if (it != current.entries.end() && it->second.sha == hashed.sha && it->second.mode == hashed.mode) 
+            {
+                it->second.mtimeNs = hashed.mtimeNs;
+                it->second.size = hashed.size;
+            }
+        }
+        writeIndex(current, lock);
+    }
+}
+
+// Changed-path Bloom filters. .mygit/commit-bloom holds, per commit, a Bloom
+// filter of every path the commit changed relative to its parent, plus each
+// of their parent directories, so log -- <path> can skip most commits
+// without reading a tree. The file is the magic "\0MGBLOM" 0x01 followed by
+// appended records:
+//
+//   <commit id: 20 raw bytes> <filter length: 2 bytes BE> <filter>
+//
+// A filter uses 10 bits per path and 7 probes of double hashing over two
+// murmur3 hashes. Length 0 marks a commit that changed too many paths to be
+// worth filtering; it matches every path.
+static const string bloomMagic("\0MGBLOM\x01", 8);
+static const size_t bloomBitsPerPath = 10;
+static const unsigned bloomProbes = 7;
+static const size_t bloomMaxPaths = 512;
+
+static uint32_t murmur3(string_view data, uint32_t seed) 
+{
+    const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+    uint32_t hash = seed;
+    size_t blocks = data.size() / 4;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    for (size_t i = 0; i < blocks; ++i) 
+    {
+        uint32_t k = uint32_t(bytes[4 * i]) | uint32_t(bytes[4 * i + 1]) << 8 | uint32_t(bytes[4 * i + 2]) << 16 | uint32_t(bytes[4 * i + 3]) << 24;
+        k *= c1;
+        k = k << 15 | k >> 17;
+        k *= c2;
+        hash ^= k;
+        hash = hash << 13 | hash >> 19;
+        hash = hash * 5 + 0xe6546b64;
+    }
+    uint32_t k = 0;
+    const unsigned char *tail = bytes + blocks * 4;
+    switch (data.size() & 3) 
+    {
+    case 3:
+        k ^= uint32_t(tail[2]) << 16;
+        [[fallthrough]];
+    case 2:
+        k ^= uint32_t(tail[1]) << 8;
+        [[fallthrough]];
+    case 1:
+        k ^= tail[0];
+        k *= c1;
+        k = k << 15 | k >> 17;
+        k *= c2;
+        hash ^= k;
+    }
+    hash ^= uint32_t(data.size());
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Call probe(bit) for each of path's bloomProbes bit positions in a filter of bits bits
+template <typename Probe>
+static void bloomPositions(string_view path, size_t bits, Probe probe) 
+{
+    uint32_t h1 = murmur3(path, 0x293ae76f);
+    uint32_t h2 = murmur3(path, 0x7e646e2c);
+    for (unsigned i = 0; i < bloomProbes; ++i) 
+    {
+        probe((h1 + uint64_t(i) * h2) % bits);
+    }
+}
+
+// The filter for the changes between two trees ("" for no tree)
+string buildCommitBloom(const string &oldTree, const string &newTree) 
+{
+    set<string> paths;
+    diffTrees(oldTree, newTree, [&](const TreeChange &change) 
+    {
+        // Once a path is present its directories are too
+        string changed = change.path;
+        while (paths.insert(changed).second) 
+        {
+            size_t slash = changed.rfind('/');
+            if (slash == string::npos) 
+            {
+                break;
+            }
+            changed.resize(slash);
+        }
+    });
+    if (paths.size() > bloomMaxPaths) 
+    {
+        return "";
+    }
+    string filter(max<size_t>(1, (paths.size() * bloomBitsPerPath + 7) / 8), '\0');
+    for (const string &changed : paths) 
+    {
+        bloomPositions(changed, filter.size() * 8, [&](size_t bit) { filter[bit / 8] |= char(1 << (bit % 8)); });
+    }
+    return filter;
+}
+
+// False only if the filter proves path unchanged
+bool bloomMayContain(const string &filter, const string &path) 
+{
+    if (filter.empty()) 
+    {
+        return true;
+    }
+    bool present = true;
+    bloomPositions(path, filter.size() * 8, [&](size_t bit) { present = present && (filter[bit / 8] >> (bit % 8) & 1); });
+    return present;
+}
+
+// Append filters to .mygit/commit-bloom, each record with a single write
+void appendCommitBlooms(const vector<pair<string, string>> &filters) 
+{
+    int fd = open((gitDir() / "commit-bloom").c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) 
+    {
+        reportError(string("Could not open .mygit/commit-bloom: ") + strerror(errno));
+        return;
+    }
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) == 0 && fileStatus.st_size == 0) 
+    {
+        writeAll(fd, bloomMagic);
+    }
+    for (const auto &[commitSha, filter] : filters) 
+    {
+        string record(rawShaLength, '\0');
+        hexToSha(commitSha, reinterpret_cast<unsigned char *>(&record[0]));
+        record += char(filter.size() >> 8);
+        record += char(filter.size());
+        record += filter;
+        writeAll(fd, record);
+    }
+    close(fd);
+}
+
+// Every stored filter by commit SHA
+unordered_map<string, string> readCommitBlooms() 
+{
+    unordered_map<string, string> filters;
+    ifstream input(gitDir() / "commit-bloom", ios::binary);
+    string data((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+    if (data.compare(0, bloomMagic.size(), bloomMagic) != 0) 
+    {
+        return filters;
+    }
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    size_t pos = bloomMagic.size();
+    while (data.size() - pos >= rawShaLength + 2) 
+    {
+        size_t length = size_t(bytes[pos + rawShaLength]) << 8 | bytes[pos + rawShaLength + 1];
+        if (data.size() - pos - rawShaLength - 2 < length) 
+        {
+            break;  // a torn final record
+        }
+        filters[shaToHex(bytes + pos)] = data.substr(pos + rawShaLength + 2, length);
+        pos += rawShaLength + 2 + length;
+    }
+    return filters;
+}
+
+// Mode and SHA of the entry at path inside a tree, reading only the trees
+// along the path; false if there is none
+bool treeEntryAt(const string &treeSha, const string &path, unsigned &mode, string &sha) 
+{
+    string current = treeSha;
+    size_t start = 0;
+    while (true) 
+    {
+        size_t slash = path.find('/', start);
+        string_view component = string_view(path).substr(start, slash == string::npos ? string::npos : slash - start);
+        string treeData;
+        if (!readObject(current, treeData)) 
+        {
+            return false;
+        }
+        TreeReader reader(treeData);
+        TreeEntryView entry;
+        bool found = false;
+        while (reader.next(entry)) 
+        {
+            if (entry.name == component) 
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found) 
+        {
+            return false;
+        }
+        if (slash == string::npos) 
+        {
+            mode = entry.mode;
+            sha = entry.sha();
+            return true;
+        }
+        if (!entry.isTree()) 
+        {
+            return false;
+        }
+        current = entry.sha();
+        start = slash + 1;
+    }
+}
+
+void commitChanges(const string &message) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+    // Check if there are any staged changes
+    IndexLock lock;
+    Index index;
+    if (!lock.acquire() || !readIndex(index)) 
+    {
+        return;
+    }
+
+    // If no files are staged, exit without committing
+    if (index.entries.empty()) 
+    {
+        cout << "No changes staged for commit.\n";
+        return;
+    }
+
+    if (!exists(gitDir() / "HEAD")) 
+    {
+        cerr << "Error: Could not read HEAD file.\n";
+        return;
+    }
+    string parent_sha = headCommitSha();
+
+    // Build the tree from the index, reusing cached subtrees
+    ObjectTransaction transaction;
+    string tree_sha = buildTree(index);
+
+    if (!parent_sha.empty() && commitTreeSha(parent_sha) == tree_sha) 
+    {
+        if (transaction.commit()) 
+        {
+            writeIndex(index, lock);
+        }
+        cout << "No changes staged for commit.\n";
+        return;
+    }
+
+    // Create a commit; its trees and the commit itself are published together
+    Commit commit = createCommit(message, tree_sha, parent_sha);
+    if (!transaction.commit()) 
+    {
+        return;
+    }
+    writeIndex(index, lock);
+    appendCommitBlooms({{commit.sha, buildCommitBloom(parent_sha.empty() ? "" : commitTreeSha(parent_sha), tree_sha)}});
+    cout << "Created commit: " << commit.sha << "\n";
+
+    // Advance the current branch (or a detached HEAD) to the new commit
+    advanceHead(commit.sha);
+}
+
+
+// Read and parse commit sha; false if the object is missing or not a commit
+bool readCommitHeaders(const string &sha, CommitHeaders &headers) 
+{
+    thread_local string data;
+    CommitView view;
+    if (!readObject(sha, data) || !parseCommit(data, view)) 
+    {
+        return false;
+    }
+    headers.tree_sha = view.tree;
+    headers.parent_sha = view.parent;
+    headers.committer = view.committer;
+    headers.timestamp = view.timestamp;
+    headers.message = view.message;
+    return true;
+}
+
+// True if a commit changed path relative to its parent, reading only the
+// trees along the path
+bool commitChangesPath(const CommitView &commit, const string &path) 
+{
+    unsigned newMode = 0, oldMode = 0;
+    string newSha, oldSha;
+    bool inNew = treeEntryAt(string(commit.tree), path, newMode, newSha);
+    bool inOld = !commit.parent.empty() && treeEntryAt(commitTreeSha(string(commit.parent)), path, oldMode, oldSha);
+    return inNew != inOld || newMode != oldMode || newSha != oldSha;
+}
+
+// With a path, only commits that changed it (or something below it) are shown
+void logCommits(const string &pathFilter) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+    if (!exists(gitDir() / "HEAD")) 
+    {
+        cerr << "Error: Could not open HEAD file.\n";
+        return;
+    }
+    string head = headCommitSha();
+    if (head.empty()) 
+    {
+        cerr << "Error: The current branch has no commits yet.\n";
+        return;
+    }
+
+    unordered_map<string, string> blooms;
+    if (!pathFilter.empty()) 
+    {
+        blooms = readCommitBlooms();
+    }
+    TraceSpan logSpan("log");
+    size_t bloomSkipped = 0;
+
+    // Start logging from the latest commit SHA; one buffer serves every commit
+    string current_sha = head;
+    string commitData;
+    CommitView view;
+    while (!current_sha.empty()) 
+    {
+        if (!readObject(current_sha, commitData) || !parseCommit(commitData, view)) 
+        {
+            cerr << "Error: Could not read commit " << current_sha << ".\n";
+            return;
+        }
+
+        if (!pathFilter.empty()) 
+        {
+            auto stored = blooms.find(current_sha);
+            bool maybe = stored == blooms.end() || bloomMayContain(stored->second, pathFilter);
+            if (!maybe) 
+            {
+                ++bloomSkipped;
+            }
+            if (!maybe || !commitChangesPath(view, pathFilter)) 
+            {
+                current_sha = view.parent;
+                continue;
+            }
+        }
+
+        // Output formatted commit information
+        cout << "Commit: " << current_sha << "\n";
+        if (!view.parent.empty()) 
+        {
+            cout << "Parent: " << view.parent << "\n";
+        }
+        cout << "Committer: " << view.committer << "\n"; 
+        cout << "Message: " << view.message << "\n";
+        cout << "Timestamp: " << view.timestamp << "\n\n";
+
+        current_sha = view.parent; 
+    }
+    logSpan.arg("bloom_skipped", bloomSkipped);
+}
+
+
+// Reachability bitmaps. write-bitmap gives every object reachable from HEAD
+// and the branch refs a bit position, in discovery order walking each history
+// oldest commit first (so an ancestor's objects mostly form a prefix of its
+// descendants'), and stores for a selection of commits the set of objects each
+// one reaches. The file .mygit/bitmaps is
+//
+//   "\0MGBITM" 0x01, <object count: 4 bytes BE>, <object ids: 20 raw bytes each, in bit order>
+//   <commit, tree and blob type bitmaps>
+//   <selected commit count: 4 bytes BE>, then per commit: <id: 20 raw bytes> <bitmap>
+//
+// where a bitmap is <word count: 4 bytes BE> and that many big-endian 64-bit
+// EWAH words: a marker (bit 63 the run value, bits 32-62 the run length in
+// words, bits 0-31 the number of literal words) followed by its literal words.
+static const string bitmapMagic("\0MGBITM\x01", 8);
+
+// Every tip, and every commit this many generations above a root, gets a bitmap
+static const unsigned bitmapCommitSpacing = 16;
+
+enum ObjectKind 
+{
+    kindCommit,
+    kindTree,
+    kindBlob
+};
+
+using Bitmap = vector<uint64_t>;
+
+static void setBit(Bitmap &bits, uint32_t position) 
+{
+    if (position / 64 >= bits.size()) 
+    {
+        bits.resize(position / 64 + 1, 0);
+    }
+    bits[position / 64] |= uint64_t(1) << (position % 64);
+}
+
+static bool testBit(const Bitmap &bits, uint32_t position) 
+{
+    return position / 64 < bits.size() && (bits[position / 64] >> (position % 64) & 1);
+}
+
+vector<uint64_t> ewahCompress(const Bitmap &bits) 
+{
+    vector<uint64_t> words;
+    size_t i = 0;
+    while (i < bits.size()) 
+    {
+        uint64_t runValue = 0;
+        uint64_t runLength = 0;
+        if (bits[i] == 0 || bits[i] == ~uint64_t(0)) 
+        {
+            uint64_t clean = bits[i];
+            runValue = clean ? 1 : 0;
+            while (i < bits.size() && bits[i] == clean && runLength < 0x7fffffff) 
+            {
+                ++runLength;
+                ++i;
+            }
+        }
+        size_t literalStart = i;
+        while (i < bits.size() && bits[i] != 0 && bits[i] != ~uint64_t(0) && i - literalStart < 0xffffffff) 
+        {
+            ++i;
+        }
+        words.push_back(runValue << 63 | runLength << 32 | uint64_t(i - literalStart));
+        words.insert(words.end(), bits.begin() + literalStart, bits.begin() + i);
+    }
+    return words;
+}
+
+// OR a compressed bitmap into bits without expanding it; false if it is
+// malformed or longer than bits
+bool ewahOrInto(const vector<uint64_t> &words, Bitmap &bits) 
+{
+    size_t position = 0;
+    size_t i = 0;
+    while (i < words.size()) 
+    {
+        uint64_t marker = words[i++];
+        uint64_t runLength = marker >> 32 & 0x7fffffff;
+        uint64_t literals = marker & 0xffffffff;
+        if (runLength > bits.size() - position || literals > words.size() - i || literals > bits.size() - position - runLength) 
+        {
+            return false;
+        }
+        if (marker >> 63) 
+        {
+            fill(bits.begin() + position, bits.begin() + position + runLength, ~uint64_t(0));
+        }
+        position += runLength;
+        for (uint64_t n = 0; n < literals; ++n) 
+        {
+            bits[position++] |= words[i++];
+        }
+    }
+    return true;
+}
+
+static size_t popcount(const Bitmap &bits) 
+{
+    size_t count = 0;
+    for (uint64_t word : bits) 
+    {
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+struct BitmapIndex 
+{
+    vector<string> ids;  // by bit position
+    unordered_map<string, uint32_t> positions;
+    vector<uint64_t> kinds[3];  // compressed, by ObjectKind
+    map<string, vector<uint64_t>> commits;  // compressed
+};
+
+// Visit the tree and every object below it. visit() returns false for objects
+// it has already seen, and their subtrees are skipped. The chunks of a chunked
+// file are visited as blobs.
+using ObjectVisitor = function<bool(const string &, ObjectKind)>;
+
+static void walkTreeObjects(const string &treeSha, const ObjectVisitor &visit) 
+{
+    if (treeSha.empty() || !visit(treeSha, kindTree)) 
+    {
+        return;
+    }
+    string treeData;
+    if (!readObject(treeSha, treeData)) 
+    {
+        cerr << "Error: Tree object " << treeSha << " not found.\n";
+        return;
+    }
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        string sha = entry.sha();
+        if (entry.isTree()) 
+        {
+            walkTreeObjects(sha, visit);
+            continue;
+        }
+        vector<ChunkRef> chunks;
+        if (visit(sha, kindBlob) && readChunkList(sha, chunks)) 
+        {
+            for (const ChunkRef &chunk : chunks) 
+            {
+                visit(shaToHex(chunk.id), kindBlob);
+            }
+        }
+    }
+}
+
+// The commits from tip back to the first one that stop() accepts (excluded)
+// or the root, newest first
+static vector<pair<string, CommitHeaders>> commitChain(const string &tip, const function<bool(const string &)> &stop) 
+{
+    vector<pair<string, CommitHeaders>> chain;
+    string sha = tip;
+    while (!sha.empty() && !stop(sha)) 
+    {
+        CommitHeaders headers;
+        if (!readCommitHeaders(sha, headers)) 
+        {
+            cerr << "Error: Commit object with SHA " << sha << " not found.\n";
+            break;
+        }
+        chain.emplace_back(sha, headers);
+        sha = headers.parent_sha;
+    }
+    return chain;
+}
+
+// HEAD followed by every ref, without duplicates
+static vector<string> refTips() 
+{
+    vector<string> tips;
+    string head = headCommitSha();
+    if (!head.empty()) 
+    {
+        tips.push_back(head);
+    }
+    unordered_set<string> seen(tips.begin(), tips.end());
+    forEachRef("refs/", [&](const string &, const string &sha) 
+    {
+        if (seen.insert(sha).second) 
+        {
+            tips.push_back(sha);
+        }
+    });
+    return tips;
+}
+
+static void appendWord32(string &out, uint32_t value) 
+{
+    for (int shift = 24; shift >= 0; shift -= 8) 
+    {
+        out += char(value >> shift);
+    }
+}
+
+static void appendBitmap(string &out, const vector<uint64_t> &words) 
+{
+    appendWord32(out, uint32_t(words.size()));
+    for (uint64_t word : words) 
+    {
+        for (int shift = 56; shift >= 0; shift -= 8) 
+        {
+            out += char(word >> shift);
+        }
+    }
+}
+
+void writeBitmaps() 
+{
+    TraceSpan span("bitmap.write");
+    vector<string> ids;
+    vector<ObjectKind> kinds;
+    unordered_map<string, uint32_t> positions;
+    struct Selected 
+    {
+        Bitmap bits;
+        size_t generation;
+    };
+    map<string, Selected> selected;
+
+    for (const string &tip : refTips()) 
+    {
+        auto chain = commitChain(tip, [&](const string &sha) { return selected.count(sha) > 0; });
+        Bitmap reach;
+        size_t generation = 0;
+        if (!chain.empty() && selected.count(chain.back().second.parent_sha)) 
+        {
+            const Selected &base = selected[chain.back().second.parent_sha];
+            reach = base.bits;
+            generation = base.generation + 1;
+        }
+
+        // Everything already in reach is reachable from this commit's parent
+        ObjectVisitor visit = [&](const string &sha, ObjectKind kind) 
+        {
+            auto found = positions.try_emplace(sha, uint32_t(ids.size()));
+            if (found.second) 
+            {
+                ids.push_back(sha);
+                kinds.push_back(kind);
+            }
+            if (testBit(reach, found.first->second)) 
+            {
+                return false;
+            }
+            setBit(reach, found.first->second);
+            return true;
+        };
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it, ++generation) 
+        {
+            visit(it->first, kindCommit);
+            walkTreeObjects(it->second.tree_sha, visit);
+            if (generation % bitmapCommitSpacing == 0 || it->first == tip) 
+            {
+                selected[it->first] = Selected{reach, generation};
+            }
+        }
+    }
+
+    if (ids.empty()) 
+    {
+        cerr << "Error: No commits to index.\n";
+        return;
+    }
+    size_t wordCount = (ids.size() + 63) / 64;
+    string out = bitmapMagic;
+    appendWord32(out, uint32_t(ids.size()));
+    for (const string &sha : ids) 
+    {
+        unsigned char id[rawShaLength];
+        hexToSha(sha, id);
+        out.append(reinterpret_cast<const char *>(id), rawShaLength);
+    }
+    for (ObjectKind kind : {kindCommit, kindTree, kindBlob}) 
+    {
+        Bitmap bits(wordCount, 0);
+        for (uint32_t position = 0; position < ids.size(); ++position) 
+        {
+            if (kinds[position] == kind) 
+            {
+                setBit(bits, position);
+            }
+        }
+        appendBitmap(out, ewahCompress(bits));
+    }
+    appendWord32(out, uint32_t(selected.size()));
+    size_t compressedWords = 0;
+    for (auto &commit : selected) 
+    {
+        unsigned char id[rawShaLength];
+        hexToSha(commit.first, id);
+        out.append(reinterpret_cast<const char *>(id), rawShaLength);
+        commit.second.bits.resize(wordCount, 0);
+        vector<uint64_t> words = ewahCompress(commit.second.bits);
+        compressedWords += words.size();
+        appendBitmap(out, words);
+    }
+
+    path lockPath = gitDir() / "bitmaps.lock";
+    {
+        ofstream output(lockPath, ios::binary | ios::trunc);
+        output.write(out.data(), out.size());
+        if (!output) 
+        {
+            cerr << "Error: Failed to write bitmaps.\n";
+            return;
+        }
+    }
+    rename(lockPath, gitDir() / "bitmaps");
+    span.arg("objects", ids.size());
+    span.arg("commits", selected.size());
+    cout << "Wrote bitmaps for " << selected.size() << " commits over " << ids.size() << " objects ("
+         << compressedWords * 8 << " bytes compressed, " << selected.size() * wordCount * 8 << " uncompressed).\n";
+}
+
+// Load .mygit/bitmaps; false if it is missing or malformed
+bool readBitmaps(BitmapIndex &index) 
+{
+    string data;
+    {
+        ifstream input(gitDir() / "bitmaps", ios::binary);
+        if (!input) 
+        {
+            return false;
+        }
+        ostringstream content;
+        content << input.rdbuf();
+        data = content.str();
+    }
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data());
+    size_t pos = bitmapMagic.size();
+    auto readWord32 = [&](uint32_t &value) 
+    {
+        if (data.size() - pos < 4) 
+        {
+            return false;
+        }
+        value = uint32_t(bytes[pos]) << 24 | uint32_t(bytes[pos + 1]) << 16 | uint32_t(bytes[pos + 2]) << 8 | bytes[pos + 3];
+        pos += 4;
+        return true;
+    };
+    auto readBitmap = [&](vector<uint64_t> &words) 
+    {
+        uint32_t count;
+        if (!readWord32(count) || (data.size() - pos) / 8 < count) 
+        {
+            return false;
+        }
+        words.resize(count);
+        for (uint64_t &word : words) 
+        {
+            word = 0;
+            for (int i = 0; i < 8; i++) 
+            {
+                word = word << 8 | bytes[pos++];
+            }
+        }
+        return true;
+    };
+
+    uint32_t objectCount;
+    if (data.compare(0, bitmapMagic.size(), bitmapMagic) != 0 || !readWord32(objectCount) || (data.size() - pos) / rawShaLength < objectCount) 
+    {
+        return false;
+    }
+    index.ids.reserve(objectCount);
+    for (uint32_t position = 0; position < objectCount; ++position, pos += rawShaLength) 
+    {
+        index.ids.push_back(shaToHex(bytes + pos));
+        index.positions.emplace(index.ids.back(), position);
+    }
+    uint32_t commitCount;
+    if (!readBitmap(index.kinds[kindCommit]) || !readBitmap(index.kinds[kindTree]) || !readBitmap(index.kinds[kindBlob]) || !readWord32(commitCount)) 
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < commitCount; ++i) 
+    {
+        if (data.size() - pos < rawShaLength) 
+        {
+            return false;
+        }
+        string sha = shaToHex(bytes + pos);
+        pos += rawShaLength;
+        if (!readBitmap(index.commits[sha])) 
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The objects reachable from tip: bits over the bitmap index's positions plus,
+// in discovery order, objects the index doesn't know. Only the commits above
+// the nearest bitmapped ancestor are walked, and their trees only as far as
+// objects that bitmap doesn't already contain.
+void reachableObjects(const BitmapIndex &index, const string &tip, Bitmap &bits, vector<pair<string, ObjectKind>> &extras) 
+{
+    TraceSpan span("bitmap.query");
+    bits.assign((index.ids.size() + 63) / 64, 0);
+    auto chain = commitChain(tip, [&](const string &sha) { return index.commits.count(sha) > 0; });
+    string base = chain.empty() ? tip : chain.back().second.parent_sha;
+    auto stored = index.commits.find(base);
+    if (stored != index.commits.end()) 
+    {
+        if (!ewahOrInto(stored->second, bits)) 
+        {
+            cerr << "Error: Corrupt bitmap for commit " << base << ".\n";
+        }
+        span.arg("base", base);
+    }
+
+    unordered_map<string, bool> seenExtras;
+    ObjectVisitor visit = [&](const string &sha, ObjectKind kind) 
+    {
+        auto known = index.positions.find(sha);
+        if (known == index.positions.end()) 
+        {
+            if (!seenExtras.emplace(sha, true).second) 
+            {
+                return false;
+            }
+            extras.emplace_back(sha, kind);
+            return true;
+        }
+        if (testBit(bits, known->second)) 
+        {
+            return false;
+        }
+        setBit(bits, known->second);
+        return true;
+    };
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) 
+    {
+        visit(it->first, kindCommit);
+        walkTreeObjects(it->second.tree_sha, visit);
+    }
+    span.arg("walked", chain.size());
+}
+
+// rev-list [--objects] and count-objects: the commit defaults to HEAD
+void revList(const string &commitSha, bool objects, bool countOnly) 
+{
+    string tip = resolveRevision(commitSha.empty() ? "HEAD" : commitSha);
+    if (tip.empty()) 
+    {
+        if (commitSha.empty()) 
+        {
+            cerr << "Error: No commits yet.\n";
+        } 
+        else 
+        {
+            cerr << "Error: " << commitSha << " is not a commit.\n";
+        }
+        return;
+    }
+    if (!objects && !countOnly) 
+    {
+        for (const auto &commit : commitChain(tip, [](const string &) { return false; })) 
+        {
+            cout << commit.first << "\n";
+        }
+        return;
+    }
+
+    BitmapIndex index;
+    if (exists(gitDir() / "bitmaps") && !readBitmaps(index)) 
+    {
+        cerr << "Error: Ignoring corrupt .mygit/bitmaps.\n";
+        index = BitmapIndex();
+    }
+    Bitmap bits;
+    vector<pair<string, ObjectKind>> extras;
+    reachableObjects(index, tip, bits, extras);
+
+    if (!countOnly) 
+    {
+        for (size_t word = 0; word < bits.size(); ++word) 
+        {
+            for (uint64_t rest = bits[word]; rest; rest &= rest - 1) 
+            {
+                cout << index.ids[word * 64 + __builtin_ctzll(rest)] << "\n";
+            }
+        }
+        for (const auto &extra : extras) 
+        {
+            cout << extra.first << "\n";
+        }
+        return;
+    }
+
+    size_t counts[3] = {0, 0, 0};
+    for (ObjectKind kind : {kindCommit, kindTree, kindBlob}) 
+    {
+        Bitmap ofKind(bits.size(), 0);
+        ewahOrInto(index.kinds[kind], ofKind);
+        for (size_t word = 0; word < bits.size(); ++word) 
+        {
+            ofKind[word] &= bits[word];
+        }
+        counts[kind] = popcount(ofKind);
+    }
+    for (const auto &extra : extras) 
+    {
+        counts[extra.second]++;
+    }
+    cout << "commits: " << counts[kindCommit] << "\n"
+         << "trees: " << counts[kindTree] << "\n"
+         << "blobs: " << counts[kindBlob] << "\n"
+         << "total: " << counts[kindCommit] + counts[kindTree] + counts[kindBlob] << "\n";
+}
+
+// Compute the changed-path filters of reachable commits made before commit
+// started recording them
+void writeBloomFilters() 
+{
+    TraceSpan span("bloom.write");
+    unordered_map<string, string> stored = readCommitBlooms();
+    vector<pair<string, string>> added;
+    for (const string &tip : refTips()) 
+    {
+        auto chain = commitChain(tip, [&](const string &sha) { return stored.count(sha) > 0; });
+        for (const auto &[commitSha, headers] : chain) 
+        {
+            string parentTree = headers.parent_sha.empty() ? "" : commitTreeSha(headers.parent_sha);
+            added.emplace_back(commitSha, buildCommitBloom(parentTree, headers.tree_sha));
+            stored.emplace(commitSha, added.back().second);
+        }
+    }
+    appendCommitBlooms(added);
+    span.arg("commits", added.size());
+    cout << "Wrote changed-path filters for " << added.size() << " commits (" << stored.size() << " in total).\n";
+}
+
+// Seconds since the epoch for a commit's "YYYY-mm-dd HH:MM:SS +zzzz"
+// timestamp (the wall-clock time in the zone the offset names), or 0
+time_t parseCommitTime(const string &timestamp) 
+{
+    int year, month, day, hour, minute, second, zone = 0;
+    char sign = '+';
+    int fields = sscanf(timestamp.c_str(), "%d-%d-%d %d:%d:%d %c%4d", &year, &month, &day, &hour, &minute, &second, &sign, &zone);
+    if (fields < 6) 
+    {
+        return 0;
+    }
+    int offset = (zone / 100 * 3600 + zone % 100 * 60) * (sign == '-' ? -1 : 1);
+    // Days from 1970-01-01 in the proleptic Gregorian calendar
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    int64_t days = int64_t(era) * 146097 + dayOfEra - 719468;
+    return time_t(days * 86400 + hour * 3600 + minute * 60 + second - offset);
+}
+
+// Commits parsed at most once per command
+class CommitCache 
+{
+public:
+    // The parsed commit, or nullptr if it can't be read. Only commits that
+    // were found are kept, so a long-lived cache sees commits written later.
+    const Commit *get(const string &sha) 
+    {
+        auto found = commits.find(sha);
+        if (found != commits.end()) 
+        {
+            return &found->second;
+        }
+        CommitHeaders headers;
+        if (!readCommitHeaders(sha, headers) || headers.tree_sha.empty()) 
+        {
+            return nullptr;
+        }
+        Commit &commit = commits[sha];
+        commit.sha = sha;
+        commit.tree_sha = headers.tree_sha;
+        commit.parent_sha = headers.parent_sha;
+        commit.message = headers.message;
+        commit.timestamp = parseCommitTime(headers.timestamp);
+        return &commit;
+    }
+
+private:
+    unordered_map<string, Commit> commits;
+};
+
+// Newest first; ties broken by SHA so the walk order is deterministic
+struct CommitQueueOrder 
+{
+    bool operator()(const Commit *a, const Commit *b) const 
+    {
+        return a->timestamp != b->timestamp ? a->timestamp < b->timestamp : a->sha < b->sha;
+    }
+};
+
+// Best common ancestors of two commits: paint everything reachable from
+// each side in timestamp order; a commit reached from both is a candidate,
+// and everything below it is marked stale. The walk ends once only stale
+// commits are queued. Returns false if a commit can't be read.
+bool mergeBases(CommitCache &cache, const string &first, const string &second, vector<string> &bases) 
+{
+    enum : unsigned 
+    {
+        fromFirst = 1,
+        fromSecond = 2,
+        stale = 4,
+        result = 8
+    };
+    TraceSpan span("merge-base");
+    unordered_map<string, unsigned> flags;
+    // Each entry remembers whether it was queued before its commit went stale
+    struct Entry 
+    {
+        const Commit *commit;
+        bool active;
+        bool operator<(const Entry &other) const { return CommitQueueOrder()(commit, other.commit); }
+    };
+    priority_queue<Entry> queue;
+    size_t activeCount = 0;
+
+    const Commit *a = cache.get(first);
+    const Commit *b = cache.get(second);
+    if (!a || !b) 
+    {
+        reportError((a ? second : first) + " is not a commit.");
+        return false;
+    }
+    if (first == second) 
+    {
+        bases.push_back(first);
+        return true;
+    }
+    flags[first] |= fromFirst;
+    flags[second] |= fromSecond;
+    queue.push({a, true});
+    queue.push({b, true});
+    activeCount = 2;
+
+    size_t walked = 0;
+    while (activeCount > 0 && !queue.empty()) 
+    {
+        Entry entry = queue.top();
+        queue.pop();
+        ++walked;
+        if (entry.active) 
+        {
+            --activeCount;
+        }
+        const Commit *commit = entry.commit;
+        unsigned &commitFlags = flags[commit->sha];
+        unsigned paint = commitFlags & (fromFirst | fromSecond | stale);
+        if ((paint & (fromFirst | fromSecond)) == (fromFirst | fromSecond) && !(paint & stale)) 
+        {
+            if (!(commitFlags & result)) 
+            {
+                commitFlags |= result;
+                bases.push_back(commit->sha);
+            }
+            paint |= stale;
+        }
+        if (commit->parent_sha.empty()) 
+        {
+            continue;
+        }
+        unsigned &parentFlags = flags[commit->parent_sha];
+        if ((parentFlags & paint) == paint) 
+        {
+            continue;
+        }
+        const Commit *parent = cache.get(commit->parent_sha);
+        if (!parent) 
+        {
+            reportError("Commit object with SHA " + commit->parent_sha + " not found.");
+            return false;
+        }
+        parentFlags |= paint;
+        bool active = !(parentFlags & stale);
+        queue.push({parent, active});
+        activeCount += active;
+    }
+    span.arg("walked", walked);
+    return true;
+}
+
+// True if ancestor is reachable from descendant (or is it). Commits have one
+// parent, so this follows descendant's parent chain to the root; timestamps
+// are not trusted to cut the walk short, since clock skew or a commit from
+// another zone would turn that into a wrong answer. error is set if a commit
+// can't be read.
+bool isAncestor(CommitCache &cache, const string &ancestor, const string &descendant, bool &error) 
+{
+    TraceSpan span("is-ancestor");
+    error = false;
+    const Commit *target = cache.get(ancestor);
+    const Commit *commit = cache.get(descendant);
+    if (!target || !commit) 
+    {
+        reportError((target ? descendant : ancestor) + " is not a commit.");
+        error = true;
+        return false;
+    }
+    unordered_set<string> seen;
+    size_t walked = 0;
+    while (true) 
+    {
+        ++walked;
+        if (commit->sha == ancestor) 
+        {
+            span.arg("walked", walked);
+            return true;
+        }
+        if (commit->parent_sha.empty() || !seen.insert(commit->sha).second) 
+        {
+            break;  // the root, or a cycle in a damaged repository
+        }
+        const Commit *parent = cache.get(commit->parent_sha);
+        if (!parent) 
+        {
+            reportError("Commit object with SHA " + commit->parent_sha + " not found.");
+            error = true;
+            return false;
+        }
+        commit = parent;
+    }
+    span.arg("walked", walked);
+    return false;
+}
+
+// merge-base / is-ancestor. Exit status 0: found (is an ancestor); 1: none
+// (is not); 2: error
+int mergeBaseCommand(const string &command, const string &firstName, const string &secondName) 
+{
+    string first = resolveRevision(firstName);
+    string second = resolveRevision(secondName);
+    first = first.empty() ? firstName : first;
+    second = second.empty() ? secondName : second;
+    CommitCache cache;
+    if (command == "is-ancestor") 
+    {
+        bool error;
+        bool ancestor = isAncestor(cache, first, second, error);
+        return error ? 2 : (ancestor ? 0 : 1);
+    }
+    vector<string> bases;
+    if (!mergeBases(cache, first, second, bases)) 
+    {
+        return 2;
+    }
+    for (const string &base : bases) 
+    {
+        cout << base << "\n";
+    }
+    return bases.empty() ? 1 : 0;
+}
+
+
+// fsck: inflate and re-hash every object, then walk everything reachable
+// from HEAD and the branch refs checking that each commit and tree refers only
+// to objects that exist. The fanout directories are shared out to
+// MYGIT_THREADS workers; objects that may be commits or trees are kept in
+// memory for the walk, everything else is hashed as it streams.
+struct FsckLink 
+{
+    string from;
+    string to;
+    ObjectKind kind;
+};
+
+struct FsckResult 
+{
+    vector<string> problems;
+    vector<string> objects;
+    unordered_map<string, string> kept;
+    uintmax_t bytes = 0;
+};
+
+static bool isHexName(const string &name, size_t length) 
+{
+    return name.size() == length && all_of(name.begin(), name.end(), [](char c) { return hexDigitValue(c) >= 0 && !isupper(c); });
+}
+
+// Feed the inflated content of an object file to state; keep the content too
+// when it is a chunk list or starts like a commit or tree
+static uintmax_t hashObjectFile(const path &objectPath, SHA_CTX &state, string &kept, bool chunkList = false) 
+{
+    zstr::ifstream input(objectPath.string(), ios::binary);
+    vector<char> buffer(64 * 1024);
+    uintmax_t size = 0;
+    bool keep = false;
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) 
+    {
+        size_t length = size_t(input.gcount());
+        if (size == 0) 
+        {
+            string_view head(buffer.data(), length);
+            keep = chunkList || head.substr(0, 5) == "tree " || head.substr(0, treeMagic.size()) == treeMagic;
+        }
+        if (keep) 
+        {
+            kept.append(buffer.data(), length);
+        }
+        SHA1_Update(&state, buffer.data(), length);
+        size += length;
+    }
+    return size;
+}
+
+static void fsckObject(const string &sha, const path &objectPath, FsckResult &result) 
+{
+    SHA_CTX state;
+    SHA1_Init(&state);
+    string kept;
+    bool chunked = storedAsChunkList(objectPath);
+    try 
+    {
+        result.bytes += hashObjectFile(objectPath, state, kept, chunked);
+
+        // A chunk list is named by the SHA-1 of the content it reassembles
+        uint64_t totalSize;
+        vector<ChunkRef> chunks;
+        if (chunked && !parseChunkList(kept, totalSize, chunks)) 
+        {
+            result.problems.push_back("corrupt " + sha + ": malformed chunk list");
+            return;
+        }
+        if (chunked) 
+        {
+            SHA1_Init(&state);
+            uint64_t reassembled = 0;
+            for (const ChunkRef &chunk : chunks) 
+            {
+                string chunkSha = shaToHex(chunk.id);
+                path chunkPath = objectFilePath(chunkSha);
+                if (!exists(chunkPath)) 
+                {
+                    result.problems.push_back("missing blob " + chunkSha + " (chunk of " + sha + ")");
+                    return;
+                }
+                string ignored;
+                reassembled += hashObjectFile(chunkPath, state, ignored);
+            }
+            result.bytes += reassembled;
+            if (reassembled != totalSize) 
+            {
+                result.problems.push_back("corrupt " + sha + ": chunks total " + to_string(reassembled) + " bytes, expected " + to_string(totalSize));
+                return;
+            }
+        }
+    } 
+    catch (const exception &ex) 
+    {
+        result.problems.push_back("corrupt " + sha + ": " + ex.what());
+        return;
+    }
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1_Final(digest, &state);
+    string actual = shaToHex(digest);
+    if (actual != sha) 
+    {
+        result.problems.push_back("corrupt " + sha + ": content hashes to " + actual);
+        return;
+    }
+
+    if (!kept.empty() && !chunked) 
+    {
+        result.kept.emplace(sha, move(kept));
+    }
+}
+
+bool fsck() 
+{
+    TraceSpan span("fsck");
+    auto start = chrono::steady_clock::now();
+
+    vector<path> fanoutDirs;
+    for (const auto &dirEntry : directory_iterator(gitDir() / "objects")) 
+    {
+        if (dirEntry.is_directory() && isHexName(dirEntry.path().filename().string(), 2)) 
+        {
+            fanoutDirs.push_back(dirEntry.path());
+        }
+    }
+    sort(fanoutDirs.begin(), fanoutDirs.end());
+
+    unsigned threads = max(1u, min<unsigned>(workerCount(), unsigned(fanoutDirs.size())));
+    vector<FsckResult> results(threads);
+    atomic<size_t> nextDir{0};
+    auto worker = [&](FsckResult &result) 
+    {
+        for (size_t d = nextDir++; d < fanoutDirs.size(); d = nextDir++) 
+        {
+            string prefix = fanoutDirs[d].filename().string();
+            for (const auto &fileEntry : directory_iterator(fanoutDirs[d])) 
+            {
+                string name = fileEntry.path().filename().string();
+                if (name.compare(0, 8, "tmp_obj_") == 0) 
+                {
+                    continue;  // an object being created right now
+                }
+                if (!isHexName(name, 38) || !fileEntry.is_regular_file()) 
+                {
+                    result.problems.push_back("unknown file " + fileEntry.path().string());
+                    continue;
+                }
+                result.objects.push_back(prefix + name);
+                fsckObject(prefix + name, fileEntry.path(), result);
+            }
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; ++t) 
+    {
+        workers.emplace_back(worker, ref(results[t]));
+    }
+    worker(results[0]);
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+
+    unordered_set<string> present;
+    unordered_map<string, string> kept;
+    vector<string> problems;
+    uintmax_t bytes = 0;
+    for (FsckResult &result : results) 
+    {
+        present.insert(result.objects.begin(), result.objects.end());
+        kept.merge(result.kept);
+        problems.insert(problems.end(), result.problems.begin(), result.problems.end());
+        bytes += result.bytes;
+    }
+
+    // Connectivity: an object's kind is known from what refers to it
+    static const char *kindNames[] = {"commit", "tree", "blob"};
+    vector<FsckLink> pending;
+    for (const string &tip : refTips()) 
+    {
+        pending.push_back({"HEAD or a branch ref", tip, kindCommit});
+    }
+    unordered_set<string> visited;
+    while (!pending.empty()) 
+    {
+        FsckLink link = pending.back();
+        pending.pop_back();
+        if (!visited.insert(link.to).second) 
+        {
+            continue;
+        }
+        if (!present.count(link.to)) 
+        {
+            problems.push_back(string("missing ") + kindNames[link.kind] + " " + link.to + " (referenced by " + link.from + ")");
+            continue;
+        }
+        if (link.kind == kindBlob) 
+        {
+            continue;
+        }
+        auto found = kept.find(link.to);
+        string data;
+        if (found != kept.end()) 
+        {
+            data = move(found->second);
+            kept.erase(found);
+        } 
+        else if (!readIntactObject(link.to, data)) 
+        {
+            problems.push_back(string("bad ") + kindNames[link.kind] + " " + link.to + " (referenced by " + link.from + ")");
+            continue;
+        }
+
+        if (link.kind == kindCommit) 
+        {
+            CommitView view;
+            if (!parseCommit(data, view)) 
+            {
+                problems.push_back("bad commit " + link.to + " (referenced by " + link.from + ")");
+                continue;
+            }
+            pending.push_back({link.to, string(view.tree), kindTree});
+            if (!view.parent.empty()) 
+            {
+                pending.push_back({link.to, string(view.parent), kindCommit});
+            }
+            continue;
+        }
+        TreeReader reader(data);
+        TreeEntryView entry;
+        while (reader.next(entry)) 
+        {
+            pending.push_back({link.to, entry.sha(), entry.isTree() ? kindTree : kindBlob});
+        }
+        if (reader.failed()) 
+        {
+            problems.push_back("bad tree " + link.to + " (referenced by " + link.from + ")");
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    seconds = max(seconds, 1e-9);
+    span.arg("objects", present.size());
+    span.arg("reachable", visited.size());
+    span.arg("bytes", bytes);
+    cout << "Checked " << present.size() << " objects (" << bytes << " bytes) in " << fixed << setprecision(3) << seconds << " s: "
+         << setprecision(0) << present.size() / seconds << " objects/s, " << setprecision(3) << bytes / seconds / 1e9 << " GB/s\n";
+
+    sort(problems.begin(), problems.end());
+    problems.erase(unique(problems.begin(), problems.end()), problems.end());
+    for (const string &problem : problems) 
+    {
+        cout << problem << "\n";
+    }
+    if (!problems.empty()) 
+    {
+        cout << problems.size() << " problem" << (problems.size() == 1 ? "" : "s") << " found.\n";
+    }
+    return problems.empty();
+}
+
+// gc --prune=<age>: delete objects nothing refers to. Mark starts from HEAD,
+// every ref and the index (staged blobs and cache-tree trees must survive
+// until they are committed). Commit chains are walked on the calling thread;
+// their trees are then marked on MYGIT_THREADS workers, which claim object IDs
+// in 256 sets sharded by fanout prefix so each ID is expanded once. Sweep
+// splits the fanout directories over the workers, and each consults only its
+// own shard. Unreachable objects are deleted only if their mtime is older than
+// the grace period: a concurrent add may be about to reference them
+// (writeObjectFile freshens the mtime of an object it finds already stored).
+// Stale tmp_obj_ files and incoming-* staging directories left by crashed
+// writers are removed by the same rule.
+struct MarkShard 
+{
+    mutex lock;
+    unordered_set<string> ids;
+};
+
+struct GcSweep 
+{
+    uintmax_t objects = 0;
+    uintmax_t removed = 0;
+    uintmax_t reclaimed = 0;
+};
+
+// Seconds of grace from "now", "never", "<n>[smhdw]" or "<n>.<unit>s.ago"
+bool parsePruneAge(const string &age, time_t &seconds) 
+{
+    if (age == "now") 
+    {
+        seconds = 0;
+        return true;
+    }
+    if (age == "never") 
+    {
+        seconds = numeric_limits<time_t>::max();
+        return true;
+    }
+    size_t digits = 0;
+    while (digits < age.size() && isdigit(static_cast<unsigned char>(age[digits]))) 
+    {
+        ++digits;
+    }
+    if (digits == 0 || digits > 9) 
+    {
+        return false;
+    }
+    time_t count = stol(age.substr(0, digits));
+    string unit = age.substr(digits);
+    if (unit.size() > 4 && unit.compare(unit.size() - 4, 4, ".ago") == 0) 
+    {
+        unit = unit.substr(0, unit.size() - 4);
+    }
+    if (!unit.empty() && unit[0] == '.') 
+    {
+        unit = unit.substr(1);
+    }
+    if (unit.size() > 1 && unit.back() == 's') 
+    {
+        unit.pop_back();
+    }
+    static const pair<const char *, time_t> units[] = {
+        {"", 1}, {"s", 1}, {"second", 1}, {"m", 60}, {"minute", 60}, {"h", 3600}, {"hour", 3600},
+        {"d", 86400}, {"day", 86400}, {"w", 604800}, {"week", 604800},
+    };
+    for (const auto &[name, scale] : units) 
+    {
+        if (unit == name) 
+        {
+            seconds = count * scale;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether blob sha is a chunk list, decided from its stored first bytes; a
+// compressed blob is inflated just far enough to tell it is readable. False if
+// the blob cannot be read.
+static bool peekChunkList(const string &sha, bool &chunked) 
+{
+    chunked = false;
+    int fd = open(objectFilePath(sha).c_str(), O_RDONLY);
+    if (fd < 0) 
+    {
+        return false;
+    }
+    unsigned char head[512];
+    ssize_t got = pread(fd, head, sizeof(head), 0);
+    close(fd);
+    if (got <= 0) 
+    {
+        return got == 0;  // the empty blob is stored as an empty file
+    }
+    string_view stored(reinterpret_cast<const char *>(head), size_t(got));
+    if (!looksCompressed(stored)) 
+    {
+        chunked = stored.substr(0, chunkListMagic.size()) == chunkListMagic;
+        return true;
+    }
+    unsigned char start[8];
+    z_stream stream = {};
+    inflateInit2(&stream, 15 + 32);
+    stream.next_in = head;
+    stream.avail_in = uInt(got);
+    stream.next_out = start;
+    stream.avail_out = sizeof(start);
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    if (ret == Z_NEED_DICT && setInflateDictionary(stream) == Z_OK) 
+    {
+        ret = inflate(&stream, Z_NO_FLUSH);
+    }
+    size_t produced = sizeof(start) - stream.avail_out;
+    inflateEnd(&stream);
+    return produced == sizeof(start) || ret == Z_STREAM_END;
+}
+
+int gcCommand(const string &pruneAge) 
+{
+    time_t grace;
+    if (!parsePruneAge(pruneAge, grace)) 
+    {
+        cerr << "Error: Invalid --prune age " << pruneAge << ".\n";
+        return 1;
+    }
+    time_t now = time(nullptr);
+    time_t cutoff = grace >= now ? numeric_limits<time_t>::min() : now - grace;
+    TraceSpan span("gc");
+    auto start = chrono::steady_clock::now();
+
+    vector<MarkShard> shards(256);
+    auto claim = [&](const string &sha) 
+    {
+        MarkShard &shard = shards[hexDigitValue(sha[0]) << 4 | hexDigitValue(sha[1])];
+        lock_guard<mutex> guard(shard.lock);
+        return shard.ids.insert(sha).second;
+    };
+    auto validSha = [](const string &sha) 
+    {
+        unsigned char id[rawShaLength];
+        return hexToSha(sha, id);
+    };
+
+    // Roots: the index, then every commit reachable from HEAD and the refs
+    Index index;
+    if (!readIndex(index)) 
+    {
+        return 1;
+    }
+    vector<string> rootTrees;
+    vector<string> rootBlobs;
+    for (const auto &[filePath, entry] : index.entries) 
+    {
+        (isSparseDirectory(entry) ? rootTrees : rootBlobs).push_back(entry.sha);
+    }
+    for (const auto &[dirPath, node] : index.cacheTree) 
+    {
+        rootTrees.push_back(node.sha);
+    }
+    string data;
+    CommitView view;
+    for (const string &tip : refTips()) 
+    {
+        for (string commit = tip; !commit.empty() && claim(commit); commit = string(view.parent)) 
+        {
+            if (!readIntactObject(commit, data) || !parseCommit(data, view)) 
+            {
+                cerr << "Error: Cannot read commit " << commit << "; run fsck. Nothing was pruned.\n";
+                return 1;
+            }
+            rootTrees.push_back(string(view.tree));
+        }
+    }
+
+    // Mark trees and blobs in parallel
+    atomic<size_t> nextRoot{0};
+    atomic<bool> incomplete{false};
+    mutex errorLock;
+    string firstError;
+    path repositoryDir = gitDir();
+    auto fail = [&](const string &sha) 
+    {
+        lock_guard<mutex> guard(errorLock);
+        if (!incomplete.exchange(true)) 
+        {
+            firstError = sha;
+        }
+    };
+    auto markBlob = [&](const string &sha) 
+    {
+        if (!validSha(sha) || !claim(sha)) 
+        {
+            return;
+        }
+        bool chunked;
+        vector<ChunkRef> chunks;
+        if (!peekChunkList(sha, chunked) || (chunked && !readChunkList(sha, chunks))) 
+        {
+            // A chunk list we cannot read would leave its chunks unmarked
+            fail(sha);
+            return;
+        }
+        for (const ChunkRef &chunk : chunks) 
+        {
+            claim(shaToHex(chunk.id));
+        }
+    };
+    auto marker = [&]() 
+    {
+        currentGitDir = repositoryDir;
+        vector<string> stack;
+        string treeData;
+        size_t i;
+        while ((i = nextRoot++) < rootTrees.size() + rootBlobs.size()) 
+        {
+            if (i >= rootTrees.size()) 
+            {
+                markBlob(rootBlobs[i - rootTrees.size()]);
+                continue;
+            }
+            if (!validSha(rootTrees[i]) || !claim(rootTrees[i])) 
+            {
+                continue;
+            }
+            stack.push_back(rootTrees[i]);
+            while (!stack.empty() && !incomplete) 
+            {
+                string tree = move(stack.back());
+                stack.pop_back();
+                bool ok = readIntactObject(tree, treeData);
+                TreeReader reader(treeData);
+                TreeEntryView entry;
+                while (ok && reader.next(entry)) 
+                {
+                    string sha = entry.sha();
+                    if (!entry.isTree()) 
+                    {
+                        markBlob(sha);
+                    } 
+                    else if (claim(sha)) 
+                    {
+                        stack.push_back(move(sha));
+                    }
+                }
+                // Trees are small enough to verify; a truncated one would
+                // otherwise read as an empty tree
+                if (!ok || reader.failed() || generateSHA1FromData(treeData) != tree) 
+                {
+                    // Whatever this tree holds would look unreachable
+                    fail(tree);
+                }
+            }
+        }
+    };
+    unsigned threads = max(1u, workerCount());
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; ++t) 
+    {
+        workers.emplace_back(marker);
+    }
+    marker();
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+    workers.clear();
+    if (incomplete) 
+    {
+        cerr << "Error: Cannot read object " << firstError << "; run fsck. Nothing was pruned.\n";
+        return 1;
+    }
+    size_t reachable = 0;
+    for (const MarkShard &shard : shards) 
+    {
+        reachable += shard.ids.size();
+    }
+    auto markDone = chrono::steady_clock::now();
+
+    // Sweep the fanout directories in parallel
+    auto expired = [&](const struct stat &fileStatus) 
+    {
+        return fileStatus.st_mtime <= cutoff;
+    };
+    vector<GcSweep> sweeps(threads);
+    atomic<int> nextDir{0};
+    auto sweeper = [&](GcSweep &sweep) 
+    {
+        for (int d = nextDir++; d < 256; d = nextDir++) 
+        {
+            char prefix[3];
+            snprintf(prefix, sizeof(prefix), "%02x", d);
+            path dir = repositoryDir / "objects" / prefix;
+            error_code ec;
+            for (auto it = directory_iterator(dir, ec); !ec && it != directory_iterator(); it.increment(ec)) 
+            {
+                string name = it->path().filename().string();
+                bool object = isHexName(name, 38);
+                struct stat fileStatus;
+                if (lstat(it->path().c_str(), &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)) 
+                {
+                    continue;
+                }
+                if (object) 
+                {
+                    ++sweep.objects;
+                }
+                if (object ? shards[d].ids.count(prefix + name) != 0 : name.compare(0, 8, "tmp_obj_") != 0) 
+                {
+                    continue;  // reachable, or not ours to remove
+                }
+                if (expired(fileStatus) && unlink(it->path().c_str()) == 0) 
+                {
+                    ++sweep.removed;
+                    sweep.reclaimed += uintmax_t(fileStatus.st_size);
+                }
+            }
+        }
+    };
+    for (unsigned t = 1; t < threads; ++t) 
+    {
+        workers.emplace_back(sweeper, ref(sweeps[t]));
+    }
+    sweeper(sweeps[0]);
+    for (thread &w : workers) 
+    {
+        w.join();
+    }
+
+    GcSweep total;
+    for (const GcSweep &sweep : sweeps) 
+    {
+        total.objects += sweep.objects;
+        total.removed += sweep.removed;
+        total.reclaimed += sweep.reclaimed;
+    }
+    // Staging directories of transactions that never committed
+    error_code ec;
+    for (auto it = directory_iterator(repositoryDir / "objects", ec); !ec && it != directory_iterator(); it.increment(ec)) 
+    {
+        struct stat dirStatus;
+        if (it->path().filename().string().compare(0, 9, "incoming-") != 0 || lstat(it->path().c_str(), &dirStatus) != 0 || !expired(dirStatus)) 
+        {
+            continue;
+        }
+        for (const auto &staged : directory_iterator(it->path(), ec)) 
+        {
+            struct stat fileStatus;
+            if (lstat(staged.path().c_str(), &fileStatus) == 0) 
+            {
+                total.reclaimed += uintmax_t(fileStatus.st_size);
+            }
+        }
+        error_code ignored;
+        remove_all(it->path(), ignored);
+    }
+
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    double markSeconds = chrono::duration<double>(markDone - start).count();
+    span.arg("reachable", reachable);
+    span.arg("removed", total.removed);
+    span.arg("reclaimed", total.reclaimed);
+    cout << "Marked " << reachable << " reachable objects in " << fixed << setprecision(3) << markSeconds << " s; swept " << total.objects
+         << " objects and removed " << total.removed << " files, reclaiming " << total.reclaimed << " bytes ("
+         << setprecision(1) << total.reclaimed / 1048576.0 << " MiB) in " << setprecision(3) << seconds << " s.\n";
+    return 0;
+}
+
+// train-dictionary: build the preset dictionary from up to trainingSampleLimit
+// bytes of trees and commits, newest first. Segments are chosen the way zstd's
+// COVER trainer does: the samples are split into one epoch per dictionary
+// segment, and each epoch contributes the segment whose distinct 8-byte
+// substrings occur in the most samples. Substrings a chosen segment covers
+// score nothing afterwards, so object IDs (unique to one object) and text
+// already in the dictionary are passed over. The best segments go last,
+// where back-references to them are shortest.
+static const size_t trainingSampleLimit = 4 * 1024 * 1024;
+static const size_t dictionaryCapacity = 32 * 1024 - 262;  // as far back as deflate reaches
+static const size_t trainingSegmentSize = 256;
+static const size_t trainingKmerSize = 8;
+static const int trainingTableBits = 20;
+
+static uint32_t kmerSlot(const char *at) 
+{
+    uint64_t kmer;
+    memcpy(&kmer, at, sizeof(kmer));
+    return uint32_t((kmer * 0x9e3779b97f4a7c15ull) >> (64 - trainingTableBits));
+}
+
+static string trainDictionary(const vector<string> &samples) 
+{
+    string all;
+    for (const string &sample : samples) 
+    {
+        all += sample;
+    }
+    if (all.size() <= dictionaryCapacity) 
+    {
+        return all;
+    }
+
+    // How many samples contain each substring (hashed, so approximately)
+    vector<uint32_t> frequency(size_t(1) << trainingTableBits, 0);
+    vector<uint32_t> lastSample(frequency.size(), UINT32_MAX);
+    size_t offset = 0;
+    for (uint32_t s = 0; s < samples.size(); ++s) 
+    {
+        for (size_t i = 0; i + trainingKmerSize <= samples[s].size(); ++i) 
+        {
+            uint32_t slot = kmerSlot(all.data() + offset + i);
+            if (lastSample[slot] != s) 
+            {
+                lastSample[slot] = s;
+                ++frequency[slot];
+            }
+        }
+        offset += samples[s].size();
+    }
+    for (uint32_t &count : frequency) 
+    {
+        count = count > 1 ? count : 0;  // in one object only: nothing to share
+    }
+
+    // Best segment of each epoch, scored with a sliding window over its kmers
+    size_t kmerCount = all.size() - trainingKmerSize + 1;
+    size_t epochs = max<size_t>(1, dictionaryCapacity / trainingSegmentSize);
+    size_t epochSize = max(kmerCount / epochs, trainingSegmentSize);
+    size_t windowKmers = trainingSegmentSize - trainingKmerSize + 1;
+    vector<uint32_t> inWindow(frequency.size(), 0);
+    vector<pair<uint64_t, size_t>> chosen;  // score, start
+    for (size_t begin = 0; begin + windowKmers <= kmerCount; begin += epochSize) 
+    {
+        size_t end = min(begin + epochSize, kmerCount);
+        uint64_t score = 0, bestScore = 0;
+        size_t bestStart = begin;
+        for (size_t i = begin; i < end; ++i) 
+        {
+            uint32_t slot = kmerSlot(all.data() + i);
+            if (inWindow[slot]++ == 0) 
+            {
+                score += frequency[slot];
+            }
+            if (i >= begin + windowKmers) 
+            {
+                uint32_t leaving = kmerSlot(all.data() + i - windowKmers);
+                if (--inWindow[leaving] == 0) 
+                {
+                    score -= frequency[leaving];
+                }
+            }
+            if (i + 1 >= begin + windowKmers && score > bestScore) 
+            {
+                bestScore = score;
+                bestStart = i + 1 - windowKmers;
+            }
+        }
+        for (size_t i = max(begin, end >= windowKmers ? end - windowKmers : 0); i < end; ++i) 
+        {
+            --inWindow[kmerSlot(all.data() + i)];
+        }
+        if (bestScore == 0) 
+        {
+            continue;
+        }
+        for (size_t i = bestStart; i < bestStart + windowKmers; ++i) 
+        {
+            frequency[kmerSlot(all.data() + i)] = 0;
+        }
+        chosen.emplace_back(bestScore, bestStart);
+    }
+
+    sort(chosen.begin(), chosen.end());
+    string dictionary;
+    for (const auto &[score, start] : chosen) 
+    {
+        dictionary.append(all, start, trainingSegmentSize);
+    }
+    if (dictionary.size() > dictionaryCapacity) 
+    {
+        dictionary.erase(0, dictionary.size() - dictionaryCapacity);
+    }
+    return dictionary;
+}
+
+// Write file through a temporary and rename(), so readers never see it partial
+static bool replaceFile(const path &file, string_view bytes) 
+{
+    path temp = file;
+    temp += ".lock";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if (fd < 0) 
+    {
+        return false;
+    }
+    bool ok = writeAll(fd, bytes) && fsync(fd) == 0;
+    close(fd);
+    ok = ok && rename(temp.c_str(), file.c_str()) == 0;
+    if (!ok) 
+    {
+        unlink(temp.c_str());
+    }
+    return ok;
+}
+
+int trainDictionaryCommand() 
+{
+    TraceSpan span("dictionary.train");
+
+    // Sample the newest commits and the trees they reach
+    vector<string> samples;
+    size_t sampleBytes = 0;
+    unordered_set<string> seen;
+    vector<string> trees;
+    string data;
+    CommitView view;
+    auto take = [&](string_view object) 
+    {
+        if (object.size() <= dictionaryObjectLimit && sampleBytes < trainingSampleLimit) 
+        {
+            samples.emplace_back(object);
+            sampleBytes += object.size();
+        }
+    };
+    for (const string &tip : refTips()) 
+    {
+        for (string commit = tip; !commit.empty() && sampleBytes < trainingSampleLimit && seen.insert(commit).second; commit = string(view.parent)) 
+        {
+            if (!readIntactObject(commit, data) || !parseCommit(data, view)) 
+            {
+                cerr << "Error: Cannot read commit " << commit << "; run fsck.\n";
+                return 1;
+            }
+            take(data);
+            trees.push_back(string(view.tree));
+        }
+    }
+    for (size_t i = 0; i < trees.size() && sampleBytes < trainingSampleLimit; ++i) 
+    {
+        if (!seen.insert(trees[i]).second || !readIntactObject(trees[i], data)) 
+        {
+            continue;
+        }
+        take(data);
+        TreeReader reader(data);
+        TreeEntryView entry;
+        while (reader.next(entry)) 
+        {
+            if (entry.isTree()) 
+            {
+                trees.push_back(entry.sha());
+            }
+        }
+    }
+    if (samples.size() < 2) 
+    {
+        cerr << "Error: Not enough commits and trees to train a dictionary.\n";
+        return 1;
+    }
+
+    // Every tenth object is held out of training, so the dictionary is
+    // measured on objects it has not seen
+    vector<string> training, heldOut;
+    size_t trainingBytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i) 
+    {
+        if (i % 10 == 9) 
+        {
+            heldOut.push_back(move(samples[i]));
+            continue;
+        }
+        trainingBytes += samples[i].size();
+        training.push_back(move(samples[i]));
+    }
+
+    string dictionary = trainDictionary(training);
+    uLong id = adler32(adler32(0, nullptr, 0), reinterpret_cast<const Bytef *>(dictionary.data()), uInt(dictionary.size()));
+    path file = dictionaryPath(id);
+    error_code ignored;
+    create_directories(file.parent_path(), ignored);
+    char idText[16];
+    snprintf(idText, sizeof(idText), "%08lx\n", id);
+    if ((!exists(file) && !replaceFile(file, dictionary)) || !replaceFile(file.parent_path() / "current", idText)) 
+    {
+        cerr << "Error: Failed to write dictionary " << file.string() << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    span.arg("id", string(idText, 8));
+    span.arg("size", dictionary.size());
+    cout << "Trained dictionary " << string(idText, 8) << " (" << dictionary.size() << " bytes) from " << training.size() << " objects ("
+         << trainingBytes << " bytes)";
+    if (heldOut.empty()) 
+    {
+        cout << ".\n";
+        return 0;
+    }
+
+    // What the held-out objects cost each way
+    uintmax_t plain = 0, primed = 0;
+    string packed;
+    for (const string &sample : heldOut) 
+    {
+        plain += deflateObject(sample).size();
+        primed += deflateWithDictionary(sample, dictionary, packed) ? packed.size() : sample.size();
+    }
+    cout << "; " << heldOut.size() << " held-out objects deflate to " << primed << " bytes with it, " << plain << " without.\n";
+    return 0;
+}
+
+
+// Write one blob of a tree to the worktree with the entry's mode
+static void checkoutBlob(const TreeEntryView &entry, const path &entryPath) 
+{
+    if (entryPath.has_parent_path()) 
+    {
+        create_directories(entryPath.parent_path());
+    }
+    
+    string blobSha = entry.sha();
+    TraceSpan span("checkout.blob");
+    span.arg("sha", blobSha);
+    span.arg("path", entryPath.string());
+    intmax_t written = materializeBlob(blobSha, entryPath);
+    if (written < 0) 
+    {
+        throw runtime_error("Blob object not found: " + blobSha);
+    }
+    span.arg("size", uintmax_t(written));
+    
+    if (entry.mode == 0100755) 
+    {
+        chmod(entryPath.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    } 
+    else 
+    {
+        chmod(entryPath.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    }
+}
+
+// Function to restore files from a tree object recursively. With a cone only
+// the subtrees leading into it are read and only files inside it written; with
+// an index every written file is also staged there.
+void restoreFromTree(const string &treeSha, const path &currentPath, SparseCone *cone = nullptr, Index *index = nullptr) 
+{
+    // Read and decompress tree object
+    string treeData;
+    if (!readObject(treeSha, treeData)) 
+    {
+        throw runtime_error("Tree object not found: " + treeSha);
+    }
+    
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        path entryPath = currentPath / entry.name;
+        string treePath = (cone || index) ? entryPath.lexically_normal().generic_string() : "";
+
+        if (!entry.isTree()) 
+        {
+            if (cone && !cone->claim(treePath)) 
+            {
+                continue;
+            }
+            checkoutBlob(entry, entryPath);
+            struct stat fileStatus;
+            if (index && stat(entryPath.c_str(), &fileStatus) == 0) 
+            {
+                stageEntry(*index, treePath, entry.sha(), formatMode(entry.mode), &fileStatus);
+            }
+        } 
+        else if (!cone || cone->leadsTo(treePath)) 
+        {
+            create_directories(entryPath);
+            restoreFromTree(entry.sha(), entryPath, cone, index);
+        }
+    }
+    if (reader.failed()) 
+    {
+        throw runtime_error("Corrupt tree object: " + treeSha);
+    }
+}
+
+// Check out a whole tree and build the index from the same walk: files inside
+// the cone are written and staged with their stat data, files outside it are
+// staged only, and subtrees that don't lead into the cone become sparse
+// directory entries without being read. Returns the entries staged below
+// dirPath, like readTreeIntoIndex.
+static long checkoutTreeIntoIndex(const string &treeSha, const string &dirPath, SparseCone &cone, Index &index) 
+{
+    string treeData;
+    if (!readObject(treeSha, treeData)) 
+    {
+        throw runtime_error("Tree object not found: " + treeSha);
+    }
+
+    string prefix = dirPath.empty() ? "" : dirPath + "/";
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    long entryCount = 0;
+    while (reader.next(entry)) 
+    {
+        string entryPath = prefix;
+        entryPath += entry.name;
+
+        if (!entry.isTree()) 
+        {
+            IndexEntry &staged = index.entries[entryPath];
+            staged = IndexEntry{formatMode(entry.mode), entry.sha()};
+            struct stat fileStatus;
+            if (cone.claim(entryPath)) 
+            {
+                checkoutBlob(entry, entryPath);
+                if (stat(entryPath.c_str(), &fileStatus) == 0) 
+                {
+                    recordStat(staged, fileStatus);
+                }
+            }
+            ++entryCount;
+        } 
+        else if (cone.leadsTo(entryPath)) 
+        {
+            create_directories(entryPath);
+            entryCount += checkoutTreeIntoIndex(entry.sha(), entryPath, cone, index);
+        } 
+        else 
+        {
+            index.entries[entryPath] = IndexEntry{formatMode(treeMode), entry.sha()};
+            ++entryCount;
+        }
+    }
+    if (reader.failed()) 
+    {
+        throw runtime_error("Corrupt tree object: " + treeSha);
+    }
+    index.cacheTree[dirPath] = CacheTreeNode{entryCount, treeSha};
+    return entryCount;
+}
+
+
+void cleanWorkingDirectory() 
+{
+    TraceSpan span("checkout.clean");
+    for (const auto &entry : directory_iterator(".")) 
+    {
+        string entryName = entry.path().filename().string();
+        // Skip .mygit directory and other special files/directories
+        if (entryName != ".mygit" && entryName != "." && entryName != "..") 
+        {
+            TraceSpan removeSpan("remove_all");
+            removeSpan.arg("path", entryName);
+            remove_all(entry.path());
+        }
+    }
+}
+
+// checkout <commit|branch>: a branch name attaches HEAD to that branch,
+// anything else detaches HEAD at the commit
+void checkoutCommit(const string &target) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return;
+    }
+    try 
+    {
+        string branch = "refs/heads/" + target;
+        string commitSha;
+        if (!isValidRefName(branch) || !readRef(branch, commitSha)) 
+        {
+            branch.clear();
+            commitSha = resolveRevision(target);
+        }
+        // Validate commit SHA format
+        if (commitSha.length() != 40) 
+        {
+            throw runtime_error("Invalid commit SHA format");
+        }
+
+        // Read commit object
+        path commitPath = objectFilePath(commitSha);
+        if (!exists(commitPath)) 
+        {
+            throw runtime_error("Commit not found: " + commitSha);
+        }
+
+        // Extract tree SHA from commit
+        string treeSha = commitTreeSha(commitSha);
+
+        if (treeSha.empty()) 
+        {
+            throw runtime_error("No tree found in commit");
+        }
+        IndexLock lock;
+        if (!lock.acquire()) 
+        {
+            return;
+        }
+        
+        cleanWorkingDirectory();
+
+        // Reset the index to the checked-out tree so the next commit starts from it
+        Index index;
+        {
+            TraceSpan span("checkout.restore");
+            span.arg("tree", treeSha);
+            SparseCone cone = sparseCone();
+            checkoutTreeIntoIndex(treeSha, "", cone, index);
+        }
+        writeIndex(index, lock);
+
+        // Point HEAD at the branch, or at the commit itself
+        if (!writeHead(branch.empty() ? commitSha : branch)) 
+        {
+            return;
+        }
+
+        if (branch.empty()) 
+        {
+            cout << "Successfully checked out commit " << commitSha << "\n";
+        } 
+        else 
+        {
+            cout << "Switched to branch " << target << " at " << commitSha << "\n";
+        }
+
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error during checkout: " << e.what() << "\n";
+    }
+}
+
+// checkout <sha> -- <path>...: overwrite just those paths in the worktree and
+// the index with their content in a commit or tree, leaving HEAD alone
+int checkoutPaths(const string &sha, const vector<string> &paths) 
+{
+    path myGitFolder = gitDir();
+
+
+    if (!exists(myGitFolder)) 
+    {
+        cerr << "Error: Git hasn't been initialized yet." << "\n";
+        return 1;
+    }
+    string treeSha = resolveTree(sha);
+    if (treeSha.empty()) 
+    {
+        cerr << "Error: " << sha << " is not a tree or commit.\n";
+        return 1;
+    }
+    IndexLock lock;
+    Index index;
+    if (!lock.acquire() || !readIndex(index)) 
+    {
+        return 1;
+    }
+
+    SparseCone cone(paths);
+    try 
+    {
+        TraceSpan span("checkout.restore");
+        span.arg("tree", treeSha);
+        restoreFromTree(treeSha, ".", &cone, &index);
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error during checkout: " << e.what() << "\n";
+        return 1;
+    }
+    vector<string> unmatched = cone.unmatched();
+    for (const string &pattern : unmatched) 
+    {
+        cerr << "Error: Path " << pattern << " did not match any file in " << sha << ".\n";
+    }
+    writeIndex(index, lock);
+    return unmatched.empty() ? 0 : 1;
+}
+
+// archive: write a tree as a ustar stream, inflating each blob straight into
+// the output. Names over 100 bytes and sizes over 8 GiB get a PAX extended
+// header. Entries carry the commit's timestamp (the current time for a tree).
+static string paxRecord(const string &key, const string &value) 
+{
+    // "<length> key=value\n", where the length counts its own digits
+    string body = " " + key + "=" + value + "\n";
+    size_t length = body.size() + 1;
+    while (to_string(length).size() + body.size() != length) 
+    {
+        length = to_string(length).size() + body.size();
+    }
+    return to_string(length) + body;
+}
+
+static void writeTarPadding(ostream &out, uintmax_t size) 
+{
+    static const char zeros[512] = {};
+    out.write(zeros, (512 - size % 512) % 512);
+}
+
+static void writeUstarHeader(ostream &out, const string &name, uintmax_t size, unsigned mode, char type, time_t mtime) 
+{
+    char header[512] = {};
+    memcpy(header, name.data(), min<size_t>(name.size(), 100));
+    snprintf(header + 100, 8, "%07o", mode & 07777);
+    snprintf(header + 108, 8, "%07o", 0);
+    snprintf(header + 116, 8, "%07o", 0);
+    snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(min<uintmax_t>(size, 077777777777)));
+    snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(min<uintmax_t>(uintmax_t(max<time_t>(mtime, 0)), 077777777777)));
+    memset(header + 148, ' ', 8);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 265, "root", 4);
+    memcpy(header + 297, "root", 4);
+    unsigned checksum = 0;
+    for (unsigned char byte : header) 
+    {
+        checksum += byte;
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+    out.write(header, sizeof(header));
+}
+
+static void writeTarHeader(ostream &out, const string &name, uintmax_t size, unsigned mode, char type, time_t mtime) 
+{
+    string pax;
+    if (name.size() > 100) 
+    {
+        pax += paxRecord("path", name);
+    }
+    if (size > 077777777777) 
+    {
+        pax += paxRecord("size", to_string(size));
+    }
+    if (!pax.empty()) 
+    {
+        writeUstarHeader(out, "pax_header", pax.size(), 0644, 'x', mtime);
+        out << pax;
+        writeTarPadding(out, pax.size());
+    }
+    writeUstarHeader(out, name, size, mode, type, mtime);
+}
+
+static void archiveTree(ostream &out, const string &treeSha, const string &prefix, time_t mtime) 
+{
+    string treeData;
+    if (!readObject(treeSha, treeData)) 
+    {
+        throw runtime_error("Tree object not found: " + treeSha);
+    }
+    TreeReader reader(treeData);
+    TreeEntryView entry;
+    while (reader.next(entry)) 
+    {
+        string name = prefix + string(entry.name);
+        string sha = entry.sha();
+        if (entry.isTree()) 
+        {
+            writeTarHeader(out, name + "/", 0, 0755, '5', mtime);
+            archiveTree(out, sha, name + "/", mtime);
+            continue;
+        }
+        intmax_t size = blobSize(sha);
+        if (size < 0) 
+        {
+            throw runtime_error("Blob object not found: " + sha);
+        }
+        writeTarHeader(out, name, uintmax_t(size), entry.mode == 0100755 ? 0755 : 0644, '0', mtime);
+        intmax_t written = streamBlob(sha, out);
+        if (written != size) 
+        {
+            throw runtime_error("Blob " + sha + " changed size while archiving");
+        }
+        writeTarPadding(out, uintmax_t(size));
+    }
+    if (reader.failed()) 
+    {
+        throw runtime_error("Corrupt tree object: " + treeSha);
+    }
+}
+
+void archiveCommand(const string &sha, const string &prefix, bool gzip) 
+{
+    string treeSha = resolveTree(sha);
+    if (treeSha.empty()) 
+    {
+        cerr << "Error: " << sha << " is not a tree or commit.\n";
+        return;
+    }
+    time_t mtime = time(nullptr);
+    CommitHeaders headers;
+    if (treeSha != sha && readCommitHeaders(sha, headers)) 
+    {
+        time_t committed = parseCommitTime(headers.timestamp);
+        if (committed != 0) 
+        {
+            mtime = committed;
+        }
+    }
+
+    TraceSpan span("archive");
+    span.arg("tree", treeSha);
+    try 
+    {
+        unique_ptr<ostream> compressed;
+        if (gzip) 
+        {
+            compressed = make_unique<zstr::ostream>(cout);
+        }
+        ostream &out = gzip ? *compressed : cout;
+        if (!prefix.empty() && prefix.back() == '/') 
+        {
+            writeTarHeader(out, prefix, 0, 0755, '5', mtime);
+        }
+        archiveTree(out, treeSha, prefix, mtime);
+        static const char endOfArchive[1024] = {};
+        out.write(endOfArchive, sizeof(endOfArchive));
+        compressed.reset();
+        cout.flush();
+    } 
+    catch (const exception &e) 
+    {
+        cerr << "Error during archive: " << e.what() << "\n";
+    }
+}
+
+// Repository: the embedding API declared in mygit.hpp. Every call runs with
+// gitDir(), error reporting and the active object transaction pointed at
+// this repository, so the functions above serve it unchanged.
+struct Repository::State 
+{
+    path gitDir;
+    string error;
+    CommitCache commits;
+    unique_ptr<ObjectTransaction> transaction;
+    string buffer;  // inflate buffer reused across reads
+};
+
+Repository::Repository() : state(make_unique<State>()) 
+{
+}
+
+Repository::~Repository() 
+{
+    if (state->transaction) 
+    {
+        call([&] 
+        {
+            state->transaction.reset();
+            return true;
+        });
+    }
+}
+
+const string &Repository::error() const 
+{
+    return state->error;
+}
+
+bool Repository::call(const function<bool()> &body) 
+{
+    state->error.clear();
+    if (state->gitDir.empty()) 
+    {
+        state->error = "No repository is open.";
+        return false;
+    }
+    path savedDir = currentGitDir;
+    string *savedSink = errorSink;
+    currentGitDir = state->gitDir;
+    errorSink = &state->error;
+    ObjectTransaction *savedTransaction = ObjectTransaction::exchangeActive(state->transaction.get());
+
+    bool ok;
+    try 
+    {
+        ok = body();
+    } 
+    catch (const exception &e) 
+    {
+        state->error = e.what();
+        ok = false;
+    }
+
+    ObjectTransaction::exchangeActive(savedTransaction);
+    errorSink = savedSink;
+    currentGitDir = savedDir;
+    // Anything reported during the call fails it, even if the body carried on
+    if (!state->error.empty()) 
+    {
+        return false;
+    }
+    if (!ok) 
+    {
+        state->error = "Operation failed.";
+    }
+    return ok;
+}
+
+bool Repository::init(const path &workTree) 
+{
+    error_code ec;
+    path dir = absolute(workTree, ec) / ".mygit";
+    create_directories(dir / "objects", ec);
+    if (!ec) 
+    {
+        create_directories(dir / "refs" / "heads", ec);
+    }
+    if (ec) 
+    {
+        state->error = "Could not create " + dir.string() + ": " + ec.message();
+        return false;
+    }
+    if (!exists(dir / "HEAD")) 
+    {
+        ofstream headFile(dir / "HEAD");
+        headFile << "ref: refs/heads/main\n";
+        if (!headFile) 
+        {
+            state->error = "Failed to create HEAD file.";
+            return false;
+        }
+    }
+    if (!exists(dir / "index")) 
+    {
+        ofstream indexFile(dir / "index");
+    }
+    return open(workTree);
+}
+
+bool Repository::open(const path &workTree) 
+{
+    error_code ec;
+    path dir = absolute(workTree, ec) / ".mygit";
+    if (ec || !is_directory(dir / "objects")) 
+    {
+        state->error = "Not a mygit repository: " + workTree.string();
+        return false;
+    }
+    if (state->transaction) 
+    {
+        state->error = "A transaction is still open.";
+        return false;
+    }
+    state->gitDir = dir;
+    state->commits = CommitCache();
+    state->error.clear();
+    return true;
+}
+
+bool Repository::hashBlob(string_view data, string &sha) 
+{
+    sha = generateSHA1FromData(data);
+    return true;
+}
+
+bool Repository::writeBlob(string_view data, string &sha) 
+{
+    return call([&] 
+    {
+        sha = storeObject(data);
+        return !sha.empty();
+    });
+}
+
+bool Repository::writeFile(const path &file, string &sha) 
+{
+    return call([&] 
+    {
+        sha = computeObjectHash(file.string(), true);
+        return !sha.empty();
+    });
+}
+
+bool Repository::readBlob(const string &sha, string &data) 
+{
+    return call([&] 
+    {
+        ostringstream out;
+        if (streamBlob(sha, out) < 0) 
+        {
+            reportError("Unable to locate the object with SHA-1 " + sha + ".");
+            return false;
+        }
+        data = out.str();
+        return true;
+    });
+}
+
+bool Repository::writeTree(vector<TreeItem> items, string &sha) 
+{
+    return call([&] 
+    {
+        unsigned char id[rawShaLength];
+        for (const TreeItem &item : items) 
+        {
+            if (item.name.empty() || item.name.find('/') != string::npos || item.name.size() > 0xffff || !hexToSha(item.sha, id)) 
+            {
+                reportError("Invalid tree entry \"" + item.name + "\".");
+                return false;
+            }
+        }
+        sha = storeObject(serializeTree(items));
+        return !sha.empty();
+    });
+}
+
+bool Repository::readTree(const string &sha, vector<TreeItem> &items) 
+{
+    return call([&] 
+    {
+        if (!readObject(sha, state->buffer)) 
+        {
+            reportError("Unable to locate the object with SHA-1 " + sha + ".");
+            return false;
+        }
+        vector<TreeItem> entries;
+        TreeReader reader(state->buffer);
+        TreeEntryView entry;
+        while (reader.next(entry)) 
+        {
+            entries.push_back({entry.mode, entry.sha(), string(entry.name)});
+        }
+        if (reader.failed()) 
+        {
+            reportError(sha + " is not a tree.");
+            return false;
+        }
+        items.swap(entries);
+        return true;
+    });
+}
+
+bool Repository::writeCommit(const string &tree, const string &parent, const string &message, string &sha) 
+{
+    return call([&] 
+    {
+        if (!parent.empty() && !state->commits.get(parent)) 
+        {
+            reportError(parent + " is not a commit.");
+            return false;
+        }
+        sha = createCommit(message, tree, parent).sha;
+        return true;
+    });
+}
+
+bool Repository::readCommit(const string &sha, CommitHeaders &headers) 
+{
+    return call([&] 
+    {
+        if (!readCommitHeaders(sha, headers)) 
+        {
+            reportError(sha + " is not a commit.");
+            return false;
+        }
+        return true;
+    });
+}
+
+bool Repository::head(string &sha) 
+{
+    return call([&] 
+    {
+        sha = headCommitSha();
+        return true;
+    });
+}
+
+bool Repository::setHead(const string &sha) 
+{
+    return call([&] 
+    {
+        if (!state->commits.get(sha)) 
+        {
+            reportError(sha + " is not a commit.");
+            return false;
+        }
+        return advanceHead(sha);
+    });
+}
+
+bool Repository::resolve(const string &name, string &sha) 
+{
+    return call([&] 
+    {
+        sha = resolveRevision(name);
+        if (sha.empty()) 
+        {
+            reportError("Unknown revision " + name + ".");
+            return false;
+        }
+        return true;
+    });
+}
+
+bool Repository::updateRef(const string &name, const string &sha) 
+{
+    return call([&] 
+    {
+        if (!state->commits.get(sha)) 
+        {
+            reportError(sha + " is not a commit.");
+            return false;
+        }
+        return writeRef(name, sha);
+    });
+}
+
+bool Repository::refs(const string &prefix, vector<pair<string, string>> &refs) 
+{
+    return call([&] 
+    {
+        refs.clear();
+        forEachRef(prefix, [&](const string &name, const string &sha) 
+        {
+            refs.emplace_back(name, sha);
+        });
+        return true;
+    });
+}
+
+bool Repository::mergeBases(const string &first, const string &second, vector<string> &bases) 
+{
+    return call([&] 
+    {
+        bases.clear();
+        return ::mergeBases(state->commits, first, second, bases);
+    });
+}
+
+bool Repository::isAncestor(const string &ancestor, const string &descendant, bool &result) 
+{
+    return call([&] 
+    {
+        bool error;
+        result = ::isAncestor(state->commits, ancestor, descendant, error);
+        return !error;
+    });
+}
+
+bool Repository::beginTransaction() 
+{
+    return call([&] 
+    {
+        if (state->transaction) 
+        {
+            reportError("A transaction is already open.");
+            return false;
+        }
+        state->transaction = make_unique<ObjectTransaction>();
+        return true;
+    });
+}
+
+bool Repository::commitTransaction() 
+{
+    return call([&] 
+    {
+        if (!state->transaction) 
+        {
+            reportError("No transaction is open.");
+            return false;
+        }
+        bool ok = state->transaction->commit();
+        state->transaction.reset();
+        return ok;
+    });
+}
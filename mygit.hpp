@@ -0,0 +1,133 @@
+// libmygit: the mygit repository as an in-process C++ API.
+//
+// Repository is the embedding interface: it addresses one .mygit directory
+// explicitly (no dependence on the current directory), reports failure by
+// returning false with the reason in error() instead of printing, and keeps
+// its caches (parsed commits, the read buffer, the open transaction) between
+// calls, so a long-running process pays no per-operation startup cost.
+//
+// The functions after it are the command layer behind the mygit CLI. They
+// work on ./.mygit and print their results to cout and errors to cerr.
+#ifndef MYGIT_HPP
+#define MYGIT_HPP
+
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Tree entry awaiting serialization
+struct TreeItem 
+{
+    unsigned mode;
+    std::string sha;
+    std::string name;
+};
+
+// Header fields of a commit object as shown by log
+struct CommitHeaders 
+{
+    std::string tree_sha;
+    std::string parent_sha;
+    std::string committer;
+    std::string timestamp;
+    std::string message;
+};
+
+// One repository. Calls on one Repository must not overlap; separate
+// Repository objects may be used from different threads at the same time.
+class Repository 
+{
+public:
+    Repository();
+    ~Repository();
+
+    Repository(const Repository &) = delete;
+    Repository &operator=(const Repository &) = delete;
+
+    // Create (or complete) workTree/.mygit and open it
+    bool init(const std::filesystem::path &workTree);
+
+    // Open the existing repository workTree/.mygit
+    bool open(const std::filesystem::path &workTree);
+
+    // Why the last call returned false
+    const std::string &error() const;
+
+    // Object IDs are 40 hex digits. The write calls skip objects that exist.
+    bool hashBlob(std::string_view data, std::string &sha);
+    bool writeBlob(std::string_view data, std::string &sha);
+    // Store a file as a blob, chunking it past the chunk threshold
+    bool writeFile(const std::filesystem::path &file, std::string &sha);
+    // Whole content of a blob (chunked blobs are reassembled)
+    bool readBlob(const std::string &sha, std::string &data);
+
+    bool writeTree(std::vector<TreeItem> items, std::string &sha);
+    bool readTree(const std::string &sha, std::vector<TreeItem> &items);
+
+    // parent may be "" for a root commit
+    bool writeCommit(const std::string &tree, const std::string &parent, const std::string &message, std::string &sha);
+    bool readCommit(const std::string &sha, CommitHeaders &headers);
+
+    // The commit HEAD resolves to ("" before the first commit), and moving
+    // it: setHead advances the branch HEAD is on, or HEAD itself if detached
+    bool head(std::string &sha);
+    bool setHead(const std::string &sha);
+
+    // Refs are full names ("refs/heads/main"). resolve also accepts a SHA,
+    // "HEAD" or a branch name; refs lists every ref under prefix, sorted.
+    bool resolve(const std::string &name, std::string &sha);
+    bool updateRef(const std::string &name, const std::string &sha);
+    bool refs(const std::string &prefix, std::vector<std::pair<std::string, std::string>> &refs);
+
+    bool mergeBases(const std::string &first, const std::string &second, std::vector<std::string> &bases);
+    bool isAncestor(const std::string &ancestor, const std::string &descendant, bool &result);
+
+    // Objects written between these two calls are staged and published
+    // together behind one durability barrier, like one `mygit add`. Objects
+    // are not readable until commitTransaction(); destroying the Repository
+    // first discards them.
+    bool beginTransaction();
+    bool commitTransaction();
+
+    struct State;
+
+private:
+    bool call(const std::function<bool()> &body);
+
+    std::unique_ptr<State> state;
+};
+
+// Command layer
+void setupGitRepo();
+int hashObjectCommand(const std::string &filePath, bool write);
+int hashObjectPaths(std::istream &in, bool write);
+void showFile(const std::string &argument, const std::string &sha1Hash);
+int writeTreeCommand();
+void listTreeContents(const std::string &sha, bool showNamesOnly);
+void addFiles(const std::vector<std::string> &file_paths);
+void commitChanges(const std::string &message);
+std::string indexPathFor(const std::filesystem::path &filePath);
+void logCommits(const std::string &pathFilter = "");
+void checkoutCommit(const std::string &target);
+int checkoutPaths(const std::string &sha, const std::vector<std::string> &paths);
+void diffTreeCommand(const std::string &first, const std::string &second, const std::string &format);
+int diffCommand(const std::string &first, const std::string &second);
+void showStatus(bool porcelain);
+void writeBitmaps();
+int mergeBaseCommand(const std::string &command, const std::string &firstName, const std::string &secondName);
+void writeBloomFilters();
+void revList(const std::string &commitSha, bool objects, bool countOnly);
+void archiveCommand(const std::string &sha, const std::string &prefix, bool gzip);
+bool fsck();
+int gcCommand(const std::string &pruneAge);
+int trainDictionaryCommand();
+void listRefs(const std::string &prefix);
+bool packRefs();
+int updateRefCommand(const std::string &name, const std::string &target);
+
+#endif // MYGIT_HPP
@@ -0,0 +1,138 @@
+// Tracing: with MYGIT_TRACE=<file>, every TraceSpan becomes a Chrome-trace
+// "complete" event and the collected events are written to <file> at exit
+// (load it in chrome://tracing or ui.perfetto.dev). Without the variable a
+// span costs one branch on traceEnabled. Shared by libmygit and the CLI, so
+// both record into the same file.
+#ifndef MYGIT_TRACE_HPP
+#define MYGIT_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+struct TraceLog 
+{
+    std::string fileName;
+    std::mutex lock;
+    std::vector<std::string> events;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    TraceLog() 
+    {
+        const char *target = getenv("MYGIT_TRACE");
+        if (target && *target) 
+        {
+            fileName = target;
+        }
+    }
+
+    ~TraceLog() 
+    {
+        if (fileName.empty()) 
+        {
+            return;
+        }
+        std::ofstream traceFile(fileName, std::ios::trunc);
+        traceFile << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < events.size(); ++i) 
+        {
+            traceFile << events[i] << (i + 1 < events.size() ? ",\n" : "\n");
+        }
+        traceFile << "],\"displayTimeUnit\":\"ms\"}\n";
+    }
+};
+
+inline TraceLog traceLog;
+inline const bool traceEnabled = !traceLog.fileName.empty();
+
+inline std::string jsonEscape(const std::string &text) 
+{
+    std::string escaped;
+    for (char c : text) 
+    {
+        if (c == '"' || c == '\\') 
+        {
+            escaped += '\\';
+            escaped += c;
+        } 
+        else if (static_cast<unsigned char>(c) < 0x20) 
+        {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        } 
+        else 
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+class TraceSpan 
+{
+public:
+    explicit TraceSpan(const char *spanName) 
+    {
+        if (traceEnabled) 
+        {
+            name = spanName;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    // Attach an argument shown with the span (object ID, path, ...)
+    void arg(const char *key, const std::string &value) 
+    {
+        if (name) 
+        {
+            args += std::string(args.empty() ? "" : ",") + "\"" + key + "\":\"" + jsonEscape(value) + "\"";
+        }
+    }
+
+    void arg(const char *key, uintmax_t value) 
+    {
+        if (name) 
+        {
+            args += std::string(args.empty() ? "" : ",") + "\"" + key + "\":" + std::to_string(value);
+        }
+    }
+
+    ~TraceSpan() 
+    {
+        if (!name) 
+        {
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ts = std::chrono::duration<double, std::micro>(start - traceLog.start).count();
+        double dur = std::chrono::duration<double, std::micro>(end - start).count();
+        static std::atomic<int> nextThreadId{1};
+        thread_local int threadId = nextThreadId++;
+
+        std::ostringstream event;
+        event << std::fixed << std::setprecision(3) << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"ts\":" << ts << ",\"dur\":" << dur
+              << ",\"pid\":" << getpid() << ",\"tid\":" << threadId << ",\"args\":{" << args << "}}";
+        std::lock_guard<std::mutex> guard(traceLog.lock);
+        traceLog.events.push_back(event.str());
+    }
+
+private:
+    const char *name = nullptr;
+    std::chrono::steady_clock::time_point start;
+    std::string args;
+};
+
+#endif // MYGIT_TRACE_HPP
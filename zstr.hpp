@@ -29,6 +29,12 @@ namespace zstr
 
 static const std::size_t default_buff_size = static_cast<std::size_t>(1 << 20);
 
+// Preset dictionaries: inflate() stops with Z_NEED_DICT on a zlib stream
+// whose header has FDICT set; the stream resumes with the dictionary this
+// returns for its Adler-32 ID (nullptr: unknown, reported as a data error)
+typedef const std::string * (*dictionary_lookup_t)(uLong dict_id);
+inline dictionary_lookup_t dictionary_lookup = nullptr;
+
 /// Exception class thrown by failed zlib operations.
 class Exception
     : public std::ios_base::failure
@@ -203,7 +209,8 @@ public:
                                  && ((b0 == 0x1F && b1 == 0x8B)         // gzip header
                                      || (b0 == 0x78 && (b1 == 0x01      // zlib header
                                                         || b1 == 0x9C
-                                                        || b1 == 0xDA))));
+                                                        || b1 == 0xDA
+                                                        || b1 == 0xBB))));  // zlib header, preset dictionary
                 }
                 if (is_text)
                 {
@@ -223,6 +230,13 @@ public:
                     zstrm_p->next_out = reinterpret_cast< decltype(zstrm_p->next_out) >(out_buff_free_start);
                     zstrm_p->avail_out = uint32_t((out_buff.get() + buff_size) - out_buff_free_start);
                     int ret = inflate(zstrm_p.get(), Z_NO_FLUSH);
+                    if (ret == Z_NEED_DICT)
+                    {
+                        const std::string * dict = dictionary_lookup ? dictionary_lookup(zstrm_p->adler) : nullptr;
+                        ret = dict ? inflateSetDictionary(zstrm_p.get(), reinterpret_cast< const Bytef * >(dict->data()), uInt(dict->size()))
+                                   : Z_DATA_ERROR;
+                        if (ret == Z_OK) ret = inflate(zstrm_p.get(), Z_NO_FLUSH);
+                    }
                     // process return code
                     if (ret != Z_OK && ret != Z_STREAM_END) throw Exception(zstrm_p.get(), ret);
                     // update in&out pointers following inflate()